@@ -0,0 +1,153 @@
+#include "backend.h"
+#include "../ext/ext2.h"
+#include "../fat/fat16.h"
+
+static Backend* backends[] = { &EXT2_backend, &FAT16_backend };
+
+static int walkDirectory(Backend *backend, void *mount, uint64_t dir_id, char *path, BackendAncestor *parent, int depth, BackendVisitor visit, void *ctx);
+static int readChildren(Backend *backend, void *mount, uint64_t dir_id, BackendEntry **children);
+static void visitFindEntry(char *path, char *name, BackendStat *stat, void *ctx);
+static int comparePaths(const void *a, const void *b);
+
+Backend* BACKEND_probe(int fd) {
+
+    Backend *backend = NULL;
+    uint8_t *buffer;
+    ssize_t length;
+
+    // Read once and zero padded, every backend looks for its signature in the same buffer
+    buffer = calloc(PROBE_SIZE, 1);
+
+    length = IMAGE_pread(fd, buffer, PROBE_SIZE, 0);
+    if (length < 0) length = 0;
+
+    for (size_t i = 0; i < sizeof(backends) / sizeof(Backend*) && backend == NULL; i++) {
+        if (backends[i]->probe(buffer, length)) backend = backends[i];
+    }
+
+    free(buffer);
+
+    return backend;
+}
+
+int BACKEND_find(Backend *backend, int fd, FindQuery *query) {
+
+    BackendFindScan scan;
+    void *mount;
+    int result;
+
+    if (backend->find != NULL) {
+        backend->find(fd, query);
+        return 0;
+    }
+
+    if ((mount = backend->mount(fd)) == NULL) return -1;
+
+    memset(&scan, 0, sizeof(BackendFindScan));
+    scan.query = query;
+
+    result = BACKEND_walk(backend, mount, backend->root_id, "", visitFindEntry, &scan);
+    backend->unmount(mount);
+
+    qsort(scan.paths, scan.count, sizeof(char*), comparePaths);
+
+    for (int i = 0; i < scan.count; i++) {
+        printf("%s\n", scan.paths[i]);
+        free(scan.paths[i]);
+    }
+
+    free(scan.paths);
+
+    // Whatever was found before a loop is still printed
+    return (result == BACKEND_LOOP) ? BACKEND_LOOP : 0;
+}
+
+int BACKEND_walk(Backend *backend, void *mount, uint64_t dir_id, char *path, BackendVisitor visit, void *ctx) {
+    return walkDirectory(backend, mount, dir_id, path, NULL, 0, visit, ctx);
+}
+
+static int walkDirectory(Backend *backend, void *mount, uint64_t dir_id, char *path, BackendAncestor *parent, int depth, BackendVisitor visit, void *ctx) {
+
+    BackendAncestor self;
+    BackendEntry *children;
+    BackendStat stat;
+    char *child_path;
+    int count, result = 0;
+
+    // A damaged directory pointing back at one of its ancestors would otherwise recurse until the stack runs out
+    if (depth >= BACKEND_MAX_DEPTH) return BACKEND_LOOP;
+
+    for (BackendAncestor *ancestor = parent; ancestor != NULL; ancestor = ancestor->parent) {
+        if (ancestor->dir_id == dir_id) return BACKEND_LOOP;
+    }
+
+    self.dir_id = dir_id;
+    self.parent = parent;
+
+    // Children are taken before descending, as backends only keep the directory they last read
+    if ((count = readChildren(backend, mount, dir_id, &children)) < 0) return -1;
+
+    for (int i = 0; i < count && result != BACKEND_LOOP; i++) {
+
+        if (children[i].has_stat) stat = children[i].stat;
+        else if (backend->stat(mount, children[i].id, &stat) < 0) continue;
+
+        child_path = malloc(strlen(path) + strlen(children[i].name) + 2);
+        sprintf(child_path, "%s/%s", path, children[i].name);
+
+        visit(child_path, children[i].name, &stat, ctx);
+
+        // Unreadable subdirectories are skipped, a loop stops the whole walk
+        if (stat.is_dir) result = walkDirectory(backend, mount, children[i].id, child_path, &self, depth + 1, visit, ctx);
+
+        free(child_path);
+    }
+
+    free(children);
+
+    return (result == BACKEND_LOOP) ? BACKEND_LOOP : 0;
+}
+
+static int readChildren(Backend *backend, void *mount, uint64_t dir_id, BackendEntry **children) {
+
+    BackendEntry entry;
+    uint64_t cookie = 0;
+    int count = 0, capacity = 0, result;
+
+    *children = NULL;
+
+    while ((result = backend->readdir(mount, dir_id, &cookie, &entry)) > 0) {
+
+        if (count == capacity) {
+            capacity = (capacity == 0) ? 16 : capacity * 2;
+            *children = realloc(*children, sizeof(BackendEntry) * capacity);
+        }
+
+        (*children)[count++] = entry;
+    }
+
+    if (result < 0) {
+        free(*children);
+        return -1;
+    }
+
+    return count;
+}
+
+static void visitFindEntry(char *path, char *name, BackendStat *stat, void *ctx) {
+
+    BackendFindScan *scan = ctx;
+
+    if (!FIND_matchesMetadata(scan->query, stat->size, stat->mtime, stat->is_dir) || !FIND_matchesName(scan->query, name)) return;
+
+    if (scan->count == scan->capacity) {
+        scan->capacity = (scan->capacity == 0) ? 64 : scan->capacity * 2;
+        scan->paths = realloc(scan->paths, sizeof(char*) * scan->capacity);
+    }
+
+    scan->paths[scan->count++] = strdup(path);
+}
+
+static int comparePaths(const void *a, const void *b) {
+    return strcmp(*(char**) a, *(char**) b);
+}
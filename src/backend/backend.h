@@ -0,0 +1,79 @@
+#ifndef _BACKEND_H_
+#define _BACKEND_H_
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "../io/image.h"
+#include "../find/find.h"
+#include "../list/filelist.h"
+#include "../fleet/fleet.h"
+
+#define PROBE_SIZE (64 << 10)
+#define MAX_NAME_LENGTH 255
+#define BACKEND_MAX_DEPTH 2048
+#define BACKEND_LOOP -2
+
+typedef struct {
+    uint64_t size;
+    time_t mtime;
+    int is_dir;
+} BackendStat;
+
+typedef struct {
+    uint64_t id;
+    int is_dir;
+    char name[MAX_NAME_LENGTH + 1];
+    char long_name[MAX_NAME_LENGTH + 1];
+    // Filled by backends whose directory entries already hold the metadata, so walks don't stat each entry
+    int has_stat;
+    BackendStat stat;
+} BackendEntry;
+
+typedef struct {
+    char* name;
+    uint64_t root_id;
+    int case_insensitive;
+
+    int (*probe)(uint8_t *buffer, size_t length);
+    void* (*mount)(int fd);
+    int (*stat)(void *mount, uint64_t id, BackendStat *stat);
+    int (*readdir)(void *mount, uint64_t dir_id, uint64_t *cookie, BackendEntry *entry);
+    int64_t (*read)(void *mount, uint64_t id, uint64_t offset, void *buffer, uint64_t length);
+    void (*unmount)(void *mount);
+
+    void (*showInfo)(int fd);
+    void (*getInfo)(int fd, FleetInfo *info);
+    void (*showDeepInfo)(int fd);
+    void (*showTree)(int fd);
+    int (*showFile)(int fd, char *file_name);
+    // Optional, drivers without a faster path of their own are searched through readdir and stat
+    void (*find)(int fd, FindQuery *query);
+    void (*showUsage)(int fd, int top);
+    int (*checkConsistency)(int fd);
+    void (*listFiles)(int fd, FileList *list);
+    void (*watch)(int fd, int interval);
+} Backend;
+
+typedef struct {
+    FindQuery* query;
+    int count;
+    int capacity;
+    char** paths;
+} BackendFindScan;
+
+typedef struct BackendAncestor {
+    uint64_t dir_id;
+    struct BackendAncestor* parent;
+} BackendAncestor;
+
+typedef void (*BackendVisitor)(char *path, char *name, BackendStat *stat, void *ctx);
+
+Backend* BACKEND_probe(int fd);
+int BACKEND_find(Backend *backend, int fd, FindQuery *query);
+int BACKEND_walk(Backend *backend, void *mount, uint64_t dir_id, char *path, BackendVisitor visit, void *ctx);
+
+#endif
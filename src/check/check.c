@@ -0,0 +1,91 @@
+#include "check.h"
+
+void CHECK_report(CheckLog *log, const char *format, ...) {
+
+    va_list args;
+    char *problem;
+    int length;
+
+    va_start(args, format);
+    length = vsnprintf(NULL, 0, format, args);
+    va_end(args);
+
+    problem = malloc(length + 1);
+
+    va_start(args, format);
+    vsnprintf(problem, length + 1, format, args);
+    va_end(args);
+
+    if (log->count == log->capacity) {
+        log->capacity = (log->capacity == 0) ? 16 : log->capacity * 2;
+        log->problems = realloc(log->problems, sizeof(char*) * log->capacity);
+    }
+
+    log->problems[log->count++] = problem;
+}
+
+void CHECK_addRef(uint8_t *refs) {
+
+    uint8_t current;
+
+    // Counts stick at the maximum instead of wrapping, so a heavily shared block still reads as shared
+    current = __atomic_load_n(refs, __ATOMIC_RELAXED);
+
+    while (current < CHECK_MAX_REFS && !__atomic_compare_exchange_n(refs, &current, current + 1, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+}
+
+void CHECK_addLink(uint16_t *links) {
+
+    uint16_t current;
+
+    // Same as block references, an inode linked from more entries than fit stays at the maximum
+    current = __atomic_load_n(links, __ATOMIC_RELAXED);
+
+    while (current < CHECK_MAX_LINKS && !__atomic_compare_exchange_n(links, &current, current + 1, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+}
+
+void CHECK_merge(CheckLog *log, CheckLog *other) {
+
+    // Problems are moved, so workers' logs can be merged in order once they finish
+    for (int i = 0; i < other->count; i++) {
+
+        if (log->count == log->capacity) {
+            log->capacity = (log->capacity == 0) ? 16 : log->capacity * 2;
+            log->problems = realloc(log->problems, sizeof(char*) * log->capacity);
+        }
+
+        log->problems[log->count++] = other->problems[i];
+    }
+
+    free(other->problems);
+    other->problems = NULL;
+    other->count = 0;
+    other->capacity = 0;
+}
+
+int CHECK_print(CheckLog *log) {
+
+    for (int i = 0; i < log->count && i < MAX_REPORTED_PROBLEMS; i++) {
+        printf("  %s\n", log->problems[i]);
+    }
+
+    if (log->count > MAX_REPORTED_PROBLEMS) {
+        printf("  ... and %d more\n", log->count - MAX_REPORTED_PROBLEMS);
+    }
+
+    printf("%s%d problem%s found.\n", (log->count > 0) ? "\n" : "", log->count, (log->count == 1) ? "" : "s");
+
+    return log->count;
+}
+
+void CHECK_free(CheckLog *log) {
+
+    for (int i = 0; i < log->count; i++) {
+        free(log->problems[i]);
+    }
+
+    free(log->problems);
+    log->problems = NULL;
+    log->count = 0;
+    log->capacity = 0;
+}
@@ -0,0 +1,27 @@
+#ifndef _CHECK_H_
+#define _CHECK_H_
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <stdint.h>
+
+#define MAX_REPORTED_PROBLEMS 1000
+#define CHECK_MAX_REFS UINT8_MAX
+#define CHECK_MAX_LINKS UINT16_MAX
+
+typedef struct {
+    int count;
+    int capacity;
+    char** problems;
+} CheckLog;
+
+void CHECK_report(CheckLog *log, const char *format, ...) __attribute__((format(printf, 2, 3)));
+void CHECK_addRef(uint8_t *refs);
+void CHECK_addLink(uint16_t *links);
+void CHECK_merge(CheckLog *log, CheckLog *other);
+int CHECK_print(CheckLog *log);
+void CHECK_free(CheckLog *log);
+
+#endif
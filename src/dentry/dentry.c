@@ -0,0 +1,259 @@
+#include "dentry.h"
+
+static void normaliseName(DentryCache *cache, char *name, char *key);
+static uint64_t hashName(char *key);
+static DentryDirectory* findDirectory(DentryCache *cache, uint64_t dir_id);
+static DentryDirectory* loadDirectory(DentryCache *cache, uint64_t dir_id);
+static int fillDirectory(DentryCache *cache, DentryDirectory *directory);
+static void insertName(DentryDirectory *directory, DentrySlot *name);
+static int evictDirectory(DentryCache *cache, DentryDirectory *keep);
+static int scanDirectory(DentryCache *cache, uint64_t dir_id, char *key, uint64_t *id, int *is_dir);
+
+void DENTRY_init(DentryCache *cache, Backend *backend, void *mount) {
+
+    cache->backend = backend;
+    cache->mount = mount;
+    cache->count = 0;
+    cache->tick = 0;
+}
+
+int DENTRY_lookup(DentryCache *cache, uint64_t dir_id, char *name, uint64_t *id, int *is_dir) {
+
+    DentryDirectory *directory;
+    DentrySlot *slot;
+    char key[MAX_NAME_LENGTH + 1];
+    uint64_t mask, index;
+
+    if (strlen(name) > MAX_NAME_LENGTH) return 0;
+
+    normaliseName(cache, name, key);
+
+    if ((directory = findDirectory(cache, dir_id)) == NULL && (directory = loadDirectory(cache, dir_id)) == NULL) {
+        // Not even one directory fits under the memory limit, it is still answered, just without caching it
+        return scanDirectory(cache, dir_id, key, id, is_dir);
+    }
+
+    directory->last_used = ++cache->tick;
+
+    // Ids that turned out not to be directories are remembered too, so lookups through a file fail without I/O
+    if (!directory->is_dir) return -1;
+
+    mask = directory->capacity - 1;
+
+    for (index = hashName(key) & mask; (slot = &directory->slots[index])->name != NULL; index = (index + 1) & mask) {
+
+        if (strcmp(slot->name, key) != 0) continue;
+
+        *id = slot->id;
+        *is_dir = slot->is_dir;
+
+        return 1;
+    }
+
+    // Tables hold whole directories, so a miss is a definite answer
+    return 0;
+}
+
+int DENTRY_resolve(DentryCache *cache, char *path, uint64_t *id) {
+
+    char *copy, *component, *context;
+    int found = 1, is_dir = 1;
+
+    *id = cache->backend->root_id;
+    copy = strdup(path);
+
+    for (component = strtok_r(copy, "/", &context); component != NULL && found; component = strtok_r(NULL, "/", &context)) {
+        found = is_dir && DENTRY_lookup(cache, *id, component, id, &is_dir) > 0;
+    }
+
+    free(copy);
+
+    return found ? 0 : -1;
+}
+
+void DENTRY_free(DentryCache *cache) {
+
+    for (int i = 0; i < cache->count; i++) {
+        ARENA_free(&cache->directories[i].arena);
+    }
+
+    cache->count = 0;
+}
+
+static void normaliseName(DentryCache *cache, char *name, char *key) {
+
+    int i;
+
+    // Case insensitive filesystems are keyed in lower case, any spelling of a name finds the same entry
+    for (i = 0; name[i] != '\0'; i++) {
+        key[i] = (cache->backend->case_insensitive && name[i] >= 'A' && name[i] <= 'Z') ? name[i] + 32 : name[i];
+    }
+
+    key[i] = '\0';
+}
+
+static uint64_t hashName(char *key) {
+
+    uint64_t hash = 0xCBF29CE484222325ULL;
+
+    // FNV-1a
+    for (; *key != '\0'; key++) {
+        hash = (hash ^ (uint8_t) *key) * 0x100000001B3ULL;
+    }
+
+    return hash;
+}
+
+static DentryDirectory* findDirectory(DentryCache *cache, uint64_t dir_id) {
+
+    for (int i = 0; i < cache->count; i++) {
+        if (cache->directories[i].dir_id == dir_id) return &cache->directories[i];
+    }
+
+    return NULL;
+}
+
+static DentryDirectory* loadDirectory(DentryCache *cache, uint64_t dir_id) {
+
+    DentryDirectory *directory;
+
+    // Least recently used directory makes room once the cache is full
+    if (cache->count == DENTRY_MAX_DIRECTORIES) evictDirectory(cache, NULL);
+
+    directory = &cache->directories[cache->count++];
+    directory->dir_id = dir_id;
+    directory->slots = NULL;
+    directory->capacity = 0;
+
+    ARENA_init(&directory->arena);
+
+    // At the memory limit older directories are dropped until this one fits
+    while (fillDirectory(cache, directory) < 0) {
+
+        ARENA_free(&directory->arena);
+
+        if (evictDirectory(cache, directory) < 0) {
+            cache->count--;
+            return NULL;
+        }
+
+        directory = findDirectory(cache, dir_id);
+    }
+
+    return directory;
+}
+
+static int fillDirectory(DentryCache *cache, DentryDirectory *directory) {
+
+    BackendEntry entry;
+    BackendStat stat;
+    DentrySlot *names = NULL;
+    char *entry_names[2] = { entry.name, entry.long_name };
+    uint64_t cookie = 0;
+    int count = 0, capacity = 0, result;
+
+    // Names go straight into the arena while reading, the table pointing at them is sized once all are known
+    while ((result = cache->backend->readdir(cache->mount, directory->dir_id, &cookie, &entry)) > 0) {
+
+        // VFAT long names are a second key for the same entry
+        for (int i = 0; i < 2 && entry_names[i][0] != '\0'; i++) {
+
+            if (count == capacity) {
+                capacity = (capacity == 0) ? 64 : capacity * 2;
+                names = realloc(names, sizeof(DentrySlot) * capacity);
+            }
+
+            normaliseName(cache, entry_names[i], entry_names[i]);
+
+            if ((names[count].name = ARENA_copyString(&directory->arena, entry_names[i], strlen(entry_names[i]))) == NULL) {
+                free(names);
+                return -1;
+            }
+
+            names[count].id = entry.id;
+            names[count].is_dir = entry.is_dir;
+            count++;
+        }
+    }
+
+    // Only a real "not a directory" is cached, a directory that failed to read (like at the memory limit) is read again next time
+    if (result < 0 && cache->backend->stat(cache->mount, directory->dir_id, &stat) == 0 && stat.is_dir) {
+        free(names);
+        return -1;
+    }
+
+    directory->is_dir = result == 0;
+
+    // Kept at most half full, so probes stay short
+    for (directory->capacity = DENTRY_MIN_SLOTS; directory->capacity < count * 2; directory->capacity *= 2);
+
+    if ((directory->slots = ARENA_alloc(&directory->arena, sizeof(DentrySlot) * directory->capacity)) == NULL) {
+        free(names);
+        return -1;
+    }
+
+    memset(directory->slots, 0, sizeof(DentrySlot) * directory->capacity);
+
+    for (int i = 0; i < count; i++) {
+        insertName(directory, &names[i]);
+    }
+
+    free(names);
+
+    return 0;
+}
+
+static void insertName(DentryDirectory *directory, DentrySlot *name) {
+
+    DentrySlot *slot;
+    uint64_t mask, index;
+
+    mask = directory->capacity - 1;
+
+    for (index = hashName(name->name) & mask; (slot = &directory->slots[index])->name != NULL; index = (index + 1) & mask) {
+        // First entry wins, like a linear scan of the directory would
+        if (strcmp(slot->name, name->name) == 0) return;
+    }
+
+    *slot = *name;
+}
+
+static int evictDirectory(DentryCache *cache, DentryDirectory *keep) {
+
+    int oldest = -1;
+
+    for (int i = 0; i < cache->count; i++) {
+
+        if (&cache->directories[i] == keep) continue;
+        if (oldest < 0 || cache->directories[i].last_used < cache->directories[oldest].last_used) oldest = i;
+    }
+
+    if (oldest < 0) return -1;
+
+    ARENA_free(&cache->directories[oldest].arena);
+    cache->directories[oldest] = cache->directories[--cache->count];
+
+    return 0;
+}
+
+static int scanDirectory(DentryCache *cache, uint64_t dir_id, char *key, uint64_t *id, int *is_dir) {
+
+    BackendEntry entry;
+    uint64_t cookie = 0;
+    char name[MAX_NAME_LENGTH + 1];
+    int result;
+
+    while ((result = cache->backend->readdir(cache->mount, dir_id, &cookie, &entry)) > 0) {
+
+        normaliseName(cache, entry.name, name);
+        if (strcmp(name, key) != 0 && entry.long_name[0] != '\0') normaliseName(cache, entry.long_name, name);
+        if (strcmp(name, key) != 0) continue;
+
+        *id = entry.id;
+        *is_dir = entry.is_dir;
+
+        return 1;
+    }
+
+    return (result < 0) ? -1 : 0;
+}
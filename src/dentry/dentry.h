@@ -0,0 +1,43 @@
+#ifndef _DENTRY_H_
+#define _DENTRY_H_
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+#include "../backend/backend.h"
+#include "../mem/arena.h"
+
+#define DENTRY_MAX_DIRECTORIES 64
+#define DENTRY_MIN_SLOTS 16
+
+typedef struct {
+    char* name;
+    uint64_t id;
+    int is_dir;
+} DentrySlot;
+
+typedef struct {
+    uint64_t dir_id;
+    int is_dir;
+    int capacity;
+    DentrySlot* slots;
+    uint64_t last_used;
+    Arena arena;
+} DentryDirectory;
+
+typedef struct {
+    Backend* backend;
+    void* mount;
+    int count;
+    uint64_t tick;
+    DentryDirectory directories[DENTRY_MAX_DIRECTORIES];
+} DentryCache;
+
+void DENTRY_init(DentryCache *cache, Backend *backend, void *mount);
+int DENTRY_lookup(DentryCache *cache, uint64_t dir_id, char *name, uint64_t *id, int *is_dir);
+int DENTRY_resolve(DentryCache *cache, char *path, uint64_t *id);
+void DENTRY_free(DentryCache *cache);
+
+#endif
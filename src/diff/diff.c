@@ -0,0 +1,133 @@
+#include "diff.h"
+
+static void addResult(DiffScan *scan, char status, FileEntry *entry_a, FileEntry *entry_b);
+static void addChunk(DiffScan *scan, uint64_t offset);
+static void compareChunks(int worker, int begin, int end, void *ctx);
+
+int DIFF_compare(int fd_a, FileList *list_a, int fd_b, FileList *list_b) {
+
+    DiffScan scan;
+    FileEntry *entry_a, *entry_b;
+    int i = 0, j = 0, cmp, differences = 0;
+
+    memset(&scan, 0, sizeof(DiffScan));
+    scan.fd_a = fd_a;
+    scan.fd_b = fd_b;
+
+    FILELIST_sort(list_a);
+    FILELIST_sort(list_b);
+
+    // Both lists are sorted by path, so a single merge pairs them up
+    while (i < list_a->count || j < list_b->count) {
+
+        entry_a = (i < list_a->count) ? &list_a->entries[i] : NULL;
+        entry_b = (j < list_b->count) ? &list_b->entries[j] : NULL;
+
+        if (entry_a == NULL) cmp = 1;
+        else if (entry_b == NULL) cmp = -1;
+        else cmp = strcmp(entry_a->path, entry_b->path);
+
+        if (cmp < 0) {
+            addResult(&scan, 'D', entry_a, NULL);
+            i++;
+            continue;
+        }
+
+        if (cmp > 0) {
+            addResult(&scan, 'A', NULL, entry_b);
+            j++;
+            continue;
+        }
+
+        i++;
+        j++;
+
+        if (entry_a->is_dir != entry_b->is_dir || entry_a->size != entry_b->size) {
+            addResult(&scan, 'M', entry_a, entry_b);
+            continue;
+        }
+
+        // Same metadata over the same physical extents is taken as unchanged without reading any data
+        if (entry_a->is_dir || (entry_a->mtime == entry_b->mtime && FILELIST_sameExtents(entry_a, entry_b))) continue;
+
+        addResult(&scan, '?', entry_a, entry_b);
+
+        // Chunks stored in the same blocks in both images are taken as unchanged too, like whole files are
+        for (uint64_t offset = 0; offset < entry_a->size; offset += DIFF_CHUNK_SIZE) {
+            if (!FILELIST_sameRange(entry_a, entry_b, offset, DIFF_CHUNK_SIZE)) addChunk(&scan, offset);
+        }
+    }
+
+    // Contents are compared chunk by chunk, so one large file is spread over every worker
+    if (scan.total_chunks > 0) PARALLEL_run(scan.total_chunks, PARALLEL_getThreadCount(scan.total_chunks), compareChunks, &scan);
+
+    for (int k = 0; k < scan.total_results; k++) {
+
+        if (scan.results[k].status == '?') continue;
+
+        printf("%c %s\n", scan.results[k].status, (scan.results[k].entry_b != NULL) ? scan.results[k].entry_b->path : scan.results[k].entry_a->path);
+        differences++;
+    }
+
+    free(scan.results);
+    free(scan.chunks);
+
+    return differences;
+}
+
+static void addResult(DiffScan *scan, char status, FileEntry *entry_a, FileEntry *entry_b) {
+
+    if (scan->total_results == scan->results_capacity) {
+        scan->results_capacity = (scan->results_capacity == 0) ? 64 : scan->results_capacity * 2;
+        scan->results = realloc(scan->results, sizeof(DiffResult) * scan->results_capacity);
+    }
+
+    scan->results[scan->total_results].status = status;
+    scan->results[scan->total_results].entry_a = entry_a;
+    scan->results[scan->total_results].entry_b = entry_b;
+    scan->total_results++;
+}
+
+static void addChunk(DiffScan *scan, uint64_t offset) {
+
+    if (scan->total_chunks == scan->chunks_capacity) {
+        scan->chunks_capacity = (scan->chunks_capacity == 0) ? 64 : scan->chunks_capacity * 2;
+        scan->chunks = realloc(scan->chunks, sizeof(DiffChunk) * scan->chunks_capacity);
+    }
+
+    // Chunks always belong to the last result added
+    scan->chunks[scan->total_chunks].result = scan->total_results - 1;
+    scan->chunks[scan->total_chunks].offset = offset;
+    scan->total_chunks++;
+}
+
+static void compareChunks(int worker, int begin, int end, void *ctx) {
+
+    DiffScan *scan = ctx;
+    DiffResult *result;
+    uint8_t *data_a, *data_b;
+    int64_t length_a, length_b;
+
+    (void) worker;
+
+    data_a = malloc(DIFF_CHUNK_SIZE);
+    data_b = malloc(DIFF_CHUNK_SIZE);
+
+    for (int i = begin; i < end; i++) {
+
+        result = &scan->results[scan->chunks[i].result];
+
+        // Once any chunk differs the rest of the file can be skipped
+        if (__atomic_load_n(&result->status, __ATOMIC_RELAXED) == 'M') continue;
+
+        length_a = FILELIST_read(scan->fd_a, result->entry_a, scan->chunks[i].offset, data_a, DIFF_CHUNK_SIZE);
+        length_b = FILELIST_read(scan->fd_b, result->entry_b, scan->chunks[i].offset, data_b, DIFF_CHUNK_SIZE);
+
+        if (length_a != length_b || length_a < 0 || memcmp(data_a, data_b, length_a) != 0) {
+            __atomic_store_n(&result->status, 'M', __ATOMIC_RELAXED);
+        }
+    }
+
+    free(data_a);
+    free(data_b);
+}
@@ -0,0 +1,38 @@
+#ifndef _DIFF_H_
+#define _DIFF_H_
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+#include "../list/filelist.h"
+#include "../parallel/parallel.h"
+
+#define DIFF_CHUNK_SIZE (1 << 20)
+
+typedef struct {
+    char status;
+    FileEntry* entry_a;
+    FileEntry* entry_b;
+} DiffResult;
+
+typedef struct {
+    int result;
+    uint64_t offset;
+} DiffChunk;
+
+typedef struct {
+    int fd_a;
+    int fd_b;
+    int total_results;
+    int results_capacity;
+    DiffResult* results;
+    int total_chunks;
+    int chunks_capacity;
+    DiffChunk* chunks;
+} DiffScan;
+
+int DIFF_compare(int fd_a, FileList *list_a, int fd_b, FileList *list_b);
+
+#endif
@@ -0,0 +1,54 @@
+#include "du.h"
+
+static int compareUsage(const void *a, const void *b);
+
+void DU_add(DUReport *report, char *path, uint64_t size, uint64_t allocated) {
+
+    if (report->count == report->capacity) {
+        report->capacity = (report->capacity == 0) ? 64 : report->capacity * 2;
+        report->entries = realloc(report->entries, sizeof(DUEntry) * report->capacity);
+    }
+
+    // The report takes ownership of the path
+    report->entries[report->count].path = path;
+    report->entries[report->count].size = size;
+    report->entries[report->count].allocated = allocated;
+    report->count++;
+}
+
+void DU_print(DUReport *report, int top) {
+
+    int total;
+
+    qsort(report->entries, report->count, sizeof(DUEntry), compareUsage);
+
+    total = (top > 0 && top < report->count) ? top : report->count;
+
+    printf("%-14s %-16s %s\n", "Allocated (KB)", "Apparent (bytes)", "Directory");
+
+    for (int i = 0; i < total; i++) {
+        printf("%-14llu %-16llu %s\n", (unsigned long long) (report->entries[i].allocated / 1024), (unsigned long long) report->entries[i].size, report->entries[i].path);
+    }
+}
+
+void DU_free(DUReport *report) {
+
+    for (int i = 0; i < report->count; i++) {
+        free(report->entries[i].path);
+    }
+
+    free(report->entries);
+    report->entries = NULL;
+    report->count = 0;
+    report->capacity = 0;
+}
+
+static int compareUsage(const void *a, const void *b) {
+
+    const DUEntry *entry_a = a, *entry_b = b;
+
+    // Largest directories first, ties broken by path to keep output stable
+    if (entry_a->allocated != entry_b->allocated) return (entry_a->allocated > entry_b->allocated) ? -1 : 1;
+    if (entry_a->size != entry_b->size) return (entry_a->size > entry_b->size) ? -1 : 1;
+    return strcmp(entry_a->path, entry_b->path);
+}
@@ -0,0 +1,25 @@
+#ifndef _DU_H_
+#define _DU_H_
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+typedef struct {
+    char* path;
+    uint64_t size;
+    uint64_t allocated;
+} DUEntry;
+
+typedef struct {
+    int count;
+    int capacity;
+    DUEntry* entries;
+} DUReport;
+
+void DU_add(DUReport *report, char *path, uint64_t size, uint64_t allocated);
+void DU_print(DUReport *report, int top);
+void DU_free(DUReport *report);
+
+#endif
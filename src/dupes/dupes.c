@@ -0,0 +1,258 @@
+#include "dupes.h"
+
+static int compareCandidates(const void *a, const void *b);
+static int isSameContent(DupeCandidate *candidate_a, DupeCandidate *candidate_b);
+static int keepGroups(DupeScan *scan);
+static void hashEnds(int worker, int index, void *ctx);
+static void hashContent(int worker, int index, void *ctx);
+static int isHardLink(DupeCandidate *candidate_a, DupeCandidate *candidate_b);
+static int compareContent(int fd, FileEntry *entry_a, FileEntry *entry_b);
+static void confirmGroup(int worker, int index, void *ctx);
+
+int DUPES_find(int fd, FileList *list) {
+
+    DupeScan scan;
+    DupeCandidate *candidate;
+    uint64_t wasted, total_wasted = 0;
+    int threads, group_end, copies, total_groups = 0;
+
+    scan.fd = fd;
+    scan.total_candidates = 0;
+    scan.candidates = malloc(sizeof(DupeCandidate) * (list->count + 1));
+    scan.total_groups = 0;
+
+    // Empty files hold no data to reclaim
+    for (int i = 0; i < list->count; i++) {
+
+        if (list->entries[i].is_dir || list->entries[i].size == 0) continue;
+
+        candidate = &scan.candidates[scan.total_candidates++];
+        candidate->entry = &list->entries[i];
+        candidate->partial_hash = 0;
+        candidate->full_hash = 0;
+        candidate->content_id = 0;
+    }
+
+    threads = PARALLEL_getThreadCount(scan.total_candidates);
+
+    // Sizes alone already rule out most files, without reading any data
+    keepGroups(&scan);
+
+    // Then the first and last 4 KB of whatever is left
+    PARALLEL_runQueue(scan.total_candidates, threads, hashEnds, &scan);
+    keepGroups(&scan);
+
+    // And only then the whole content, for files bigger than what the partial hash already covered
+    PARALLEL_runQueue(scan.total_candidates, threads, hashContent, &scan);
+    keepGroups(&scan);
+
+    // Equal hashes are only likely equal content, so what is left is compared byte for byte, a group per worker
+    scan.groups = malloc(sizeof(int) * (scan.total_candidates + 1));
+
+    for (int i = 0; i < scan.total_candidates; i = group_end) {
+
+        for (group_end = i + 1; group_end < scan.total_candidates && isSameContent(&scan.candidates[i], &scan.candidates[group_end]); group_end++);
+        scan.groups[scan.total_groups++] = i;
+    }
+
+    scan.groups[scan.total_groups] = scan.total_candidates;
+
+    PARALLEL_runQueue(scan.total_groups, PARALLEL_getThreadCount(scan.total_groups), confirmGroup, &scan);
+    keepGroups(&scan);
+
+    for (int i = 0; i < scan.total_candidates; i = group_end) {
+
+        for (group_end = i + 1; group_end < scan.total_candidates && isSameContent(&scan.candidates[i], &scan.candidates[group_end]); group_end++);
+
+        // Paths sharing the same extents are hard links, not copies
+        copies = 1;
+
+        for (int j = i + 1; j < group_end; j++) {
+
+            copies++;
+
+            for (int k = i; k < j; k++) {
+
+                if (isHardLink(&scan.candidates[j], &scan.candidates[k])) {
+                    copies--;
+                    break;
+                }
+            }
+        }
+
+        if (copies < 2) continue;
+
+        wasted = scan.candidates[i].entry->size * (copies - 1);
+
+        printf("%llu bytes x %d (%llu bytes wasted)\n", (unsigned long long) scan.candidates[i].entry->size, copies, (unsigned long long) wasted);
+
+        for (int j = i; j < group_end; j++) {
+            printf("  %s\n", scan.candidates[j].entry->path);
+        }
+
+        printf("\n");
+
+        total_wasted += wasted;
+        total_groups++;
+    }
+
+    printf("%d duplicate group%s, %llu bytes wasted.\n", total_groups, (total_groups == 1) ? "" : "s", (unsigned long long) total_wasted);
+
+    free(scan.groups);
+    free(scan.candidates);
+
+    return total_groups;
+}
+
+static int compareCandidates(const void *a, const void *b) {
+
+    const DupeCandidate *candidate_a = a, *candidate_b = b;
+
+    if (candidate_a->entry->size != candidate_b->entry->size) return (candidate_a->entry->size < candidate_b->entry->size) ? -1 : 1;
+    if (candidate_a->partial_hash != candidate_b->partial_hash) return (candidate_a->partial_hash < candidate_b->partial_hash) ? -1 : 1;
+    if (candidate_a->full_hash != candidate_b->full_hash) return (candidate_a->full_hash < candidate_b->full_hash) ? -1 : 1;
+    if (candidate_a->content_id != candidate_b->content_id) return (candidate_a->content_id < candidate_b->content_id) ? -1 : 1;
+
+    // Same content, sorted by path to keep output stable
+    return strcmp(candidate_a->entry->path, candidate_b->entry->path);
+}
+
+static int isSameContent(DupeCandidate *candidate_a, DupeCandidate *candidate_b) {
+    return candidate_a->entry->size == candidate_b->entry->size && candidate_a->partial_hash == candidate_b->partial_hash && candidate_a->full_hash == candidate_b->full_hash && candidate_a->content_id == candidate_b->content_id;
+}
+
+static int keepGroups(DupeScan *scan) {
+
+    int kept = 0, group_end;
+
+    qsort(scan->candidates, scan->total_candidates, sizeof(DupeCandidate), compareCandidates);
+
+    // Candidates without any other of equal size and hashes so far can't be duplicates
+    for (int i = 0; i < scan->total_candidates; i = group_end) {
+
+        for (group_end = i + 1; group_end < scan->total_candidates && isSameContent(&scan->candidates[i], &scan->candidates[group_end]); group_end++);
+
+        if (group_end - i < 2) continue;
+
+        memmove(&scan->candidates[kept], &scan->candidates[i], sizeof(DupeCandidate) * (group_end - i));
+        kept += group_end - i;
+    }
+
+    scan->total_candidates = kept;
+
+    return kept;
+}
+
+static void hashEnds(int worker, int index, void *ctx) {
+
+    DupeScan *scan = ctx;
+    DupeCandidate *candidate;
+    uint8_t data[PARTIAL_HASH_SIZE * 2];
+    uint64_t size;
+    int64_t length;
+
+    (void) worker;
+
+    candidate = &scan->candidates[index];
+    size = candidate->entry->size;
+
+    // Files up to 8 KB are hashed whole here
+    if (size <= PARTIAL_HASH_SIZE * 2) {
+        length = FILELIST_read(scan->fd, candidate->entry, 0, data, size);
+    }
+    else {
+        length = FILELIST_read(scan->fd, candidate->entry, 0, data, PARTIAL_HASH_SIZE);
+        length += FILELIST_read(scan->fd, candidate->entry, size - PARTIAL_HASH_SIZE, data + PARTIAL_HASH_SIZE, PARTIAL_HASH_SIZE);
+    }
+
+    candidate->partial_hash = HASH_compute(data, (length > 0) ? length : 0, 0);
+}
+
+static void hashContent(int worker, int index, void *ctx) {
+
+    DupeScan *scan = ctx;
+    DupeCandidate *candidate;
+    uint8_t *data;
+    uint64_t hash = 0;
+    int64_t length;
+
+    (void) worker;
+
+    candidate = &scan->candidates[index];
+
+    if (candidate->entry->size <= PARTIAL_HASH_SIZE * 2) return;
+
+    data = malloc(FULL_HASH_CHUNK_SIZE);
+
+    // Each chunk's hash seeds the next one
+    for (uint64_t offset = 0; offset < candidate->entry->size; offset += FULL_HASH_CHUNK_SIZE) {
+
+        length = FILELIST_read(scan->fd, candidate->entry, offset, data, FULL_HASH_CHUNK_SIZE);
+        if (length <= 0) break;
+
+        hash = HASH_compute(data, length, hash);
+    }
+
+    candidate->full_hash = hash;
+
+    free(data);
+}
+
+static int isHardLink(DupeCandidate *candidate_a, DupeCandidate *candidate_b) {
+
+    // Files made only of holes have no extents, and share no data even when their lists compare equal
+    return candidate_a->entry->extent_count > 0 && FILELIST_sameExtents(candidate_a->entry, candidate_b->entry);
+}
+
+static int compareContent(int fd, FileEntry *entry_a, FileEntry *entry_b) {
+
+    uint8_t *data_a, *data_b;
+    int64_t length_a, length_b;
+    int same = 1;
+
+    data_a = malloc(FULL_HASH_CHUNK_SIZE);
+    data_b = malloc(FULL_HASH_CHUNK_SIZE);
+
+    for (uint64_t offset = 0; same && offset < entry_a->size; offset += FULL_HASH_CHUNK_SIZE) {
+
+        length_a = FILELIST_read(fd, entry_a, offset, data_a, FULL_HASH_CHUNK_SIZE);
+        length_b = FILELIST_read(fd, entry_b, offset, data_b, FULL_HASH_CHUNK_SIZE);
+
+        same = length_a == length_b && length_a > 0 && memcmp(data_a, data_b, length_a) == 0;
+    }
+
+    free(data_a);
+    free(data_b);
+
+    return same;
+}
+
+static void confirmGroup(int worker, int index, void *ctx) {
+
+    DupeScan *scan = ctx;
+    DupeCandidate *candidate, *first;
+    int begin, end, k;
+
+    (void) worker;
+
+    begin = scan->groups[index];
+    end = scan->groups[index + 1];
+
+    // Each candidate joins the first earlier one it matches, whose own id is its index, or starts a new id
+    for (int j = begin; j < end; j++) {
+
+        candidate = &scan->candidates[j];
+        candidate->content_id = j;
+
+        for (k = begin; k < j; k++) {
+
+            first = &scan->candidates[k];
+            if (first->content_id != k) continue;
+
+            if (isHardLink(candidate, first) || compareContent(scan->fd, candidate->entry, first->entry)) {
+                candidate->content_id = k;
+                break;
+            }
+        }
+    }
+}
@@ -0,0 +1,33 @@
+#ifndef _DUPES_H_
+#define _DUPES_H_
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+#include "../list/filelist.h"
+#include "../parallel/parallel.h"
+#include "../hash/hash.h"
+
+#define PARTIAL_HASH_SIZE 4096
+#define FULL_HASH_CHUNK_SIZE (1 << 20)
+
+typedef struct {
+    FileEntry* entry;
+    uint64_t partial_hash;
+    uint64_t full_hash;
+    int content_id;
+} DupeCandidate;
+
+typedef struct {
+    int fd;
+    int total_candidates;
+    DupeCandidate* candidates;
+    int total_groups;
+    int* groups;
+} DupeScan;
+
+int DUPES_find(int fd, FileList *list);
+
+#endif
@@ -3,22 +3,72 @@
 static Superblock getSuperblock(int fd);
 static int isInternalDirectory(char* name);
 void getBlocks(int fd, int block_id, int** blocks, int* total_blocks_fetched, int total_blocks, int block_size, int level);
-static int isLastEntry(int fd, int *next_entry, int *blocks, int *current_block, int total_blocks, int block_size);
-static char* getNestFormat(EXTNest nest);
-static EXTNest* clone(EXTNest *nest, int is_last);
-static Inode* traverseDirectory(int fd, int inode_id, char *file_name, EXTNest *nest, Superblock sb);
+static Inode* traverseDirectory(int fd, int inode_id, char *file_name, Superblock sb);
 void printBlockData(int fd, int block_id, long *bytes_read, long file_size, int block_size, int level);
 static void showFile(int fd, Inode* inode, Superblock sb);
-
-int EXT2_check(int fd) {
-
-    uint16_t buffer;
-
-    lseek(fd, SUPERBLOCK_OFFSET + 56, SEEK_SET);
-    read(fd, &buffer, 2);
-
-    return buffer == 0xEF53;
-}
+static uint64_t getFileSize(Inode *inode);
+static int getGroupCount(Superblock sb);
+static GroupDescriptor* getGroupDescriptors(int fd, Superblock sb, int *group_count);
+static void scanInodeTables(int fd, Superblock sb, GroupDescriptor *gds, int first_group, int last_group, int reserved, void (*visit)(uint32_t inode_id, Inode *inode, void *ctx), void *ctx);
+static void walkBlocks(int fd, uint32_t block_id, int level, int block_size, void (*visit)(uint32_t block_id, int level, void *ctx), void *ctx);
+static void walkInodeBlocks(int fd, Inode *inode, int block_size, void (*visit)(uint32_t block_id, int level, void *ctx), void *ctx);
+static void addId(EXTIdList *list, uint32_t id);
+static void addInode(EXTInodeList *list, uint32_t id, Inode *inode);
+static void addDataBlock(uint32_t block_id, int level, void *ctx);
+static int findIndex(uint32_t *ids, int count, uint32_t id);
+static int containsId(EXTIdList *list, uint32_t id);
+static int compareNames(const void *a, const void *b);
+static EXTNameMap buildNameMap(int fd, Superblock sb, EXTInodeList *dirs, int (*wanted)(uint32_t inode_id, int is_dir, void *ctx), void *ctx);
+static EXTName* findName(EXTNameMap *map, uint32_t inode_id);
+static char* getPath(EXTNameMap *map, EXTName *name, int depth);
+static void freeNameMap(EXTNameMap *map);
+static void visitFindInode(uint32_t inode_id, Inode *inode, void *ctx);
+static int isFindCandidate(uint32_t inode_id, int is_dir, void *ctx);
+static int comparePaths(const void *a, const void *b);
+static int compareIds(const void *a, const void *b);
+static void collectDirectory(uint32_t inode_id, Inode *inode, void *ctx);
+static uint32_t countUsedBits(uint8_t *bitmap, uint32_t total_bits);
+static void addFreeRun(uint64_t *free_runs, uint32_t length);
+static void countFreeRuns(uint8_t *bitmap, EXTGroupBitmaps *group);
+static void scanGroups(int worker, int begin, int end, void *ctx);
+static void visitFragmentInode(uint32_t inode_id, Inode *inode, void *ctx);
+static void addFragment(EXTFragmentation *fragmentation, EXTFragment fragment);
+static int isFragmentCandidate(uint32_t inode_id, int is_dir, void *ctx);
+static int hasSuperblockCopy(Superblock sb, int group);
+static void collectListInode(uint32_t inode_id, Inode *inode, void *ctx);
+static void mapBlocks(int fd, uint32_t block_id, int level, int block_size, uint64_t *logical_block, FileEntry *entry);
+static void mapInodeExtents(int fd, Inode *inode, int block_size, FileEntry *entry);
+static void markBlock(EXTCheckScan *scan, uint32_t block_id);
+static void markMetadataBlocks(EXTCheckScan *scan, int group_count);
+static void markInodeBlock(uint32_t block_id, int level, void *ctx);
+static void checkDirectoryBlocks(EXTCheckScan *scan, Inode *inode);
+static void visitCheckInode(uint32_t inode_id, Inode *inode, void *ctx);
+static void checkInodes(int worker, int begin, int end, void *ctx);
+static void checkGroups(int worker, int begin, int end, void *ctx);
+static void readInode(int fd, Superblock sb, GroupDescriptor *gds, uint32_t inode_id, Inode *inode);
+static void loadTreeLevel(int fd, Superblock sb, GroupDescriptor *gds, Tree *tree, int begin, int end);
+static void addTreeEntries(Tree *tree, int dir, uint8_t *data, int length, int block_size);
+static void readInodeBitmap(EXTWatch *watch, int group, uint8_t *inode_bitmap);
+static void hashInodeTable(EXTWatch *watch, int group, EXTIdList *changed);
+static void addWatchBlock(EXTWatch *watch, uint32_t block, uint32_t dir_id, uint64_t hash);
+static void hashDirectoryBlocks(EXTWatch *watch, EXTWatchScan *scan);
+static int listWatchDirectory(uint64_t id, WatchEntry **entries, uint64_t *fingerprint, void *ctx);
+static void loadWatchGroups(EXTWatch *watch);
+static void pollChanges(EXTWatch *watch);
+static void findWatchParents(EXTWatch *watch, EXTIdList *inodes, EXTIdList *dirs);
+static void refreshWatchDirectories(EXTWatch *watch, EXTIdList *dirs);
+static void visitUsageInode(uint32_t inode_id, Inode *inode, void *ctx);
+static int probe(uint8_t *buffer, size_t length);
+static void* mountFilesystem(int fd);
+static int statEntry(void *mount, uint64_t id, BackendStat *stat);
+static int readDirectory(void *mount, uint64_t dir_id, uint64_t *cookie, BackendEntry *entry);
+static int isEntryOffset(uint8_t *data, int offset, int block_size);
+static int64_t readFile(void *mount, uint64_t id, uint64_t offset, void *buffer, uint64_t length);
+static void unmountFilesystem(void *mount);
+static void* allocateCache(EXTMount *mount, Arena *cache, size_t size);
+static int isAnyEntry(uint32_t inode_id, int is_dir, void *ctx);
+static int compareUsageInodes(const void *a, const void *b);
+static EXTUsage* findUsage(EXTUsageScan *scan, uint32_t inode_id);
 
 void EXT2_showInfo(int fd) {
 
@@ -53,19 +103,165 @@ void EXT2_showInfo(int fd) {
     printf("  Last Written: %s\n", ctime(&time));
 }
 
-void EXT2_showTree(int fd) {
+void EXT2_getInfo(int fd, FleetInfo *info) {
 
     Superblock sb;
-    EXTNest *nest;
 
     sb = getSuperblock(fd);
 
-    nest = malloc(sizeof(EXTNest));
-    nest->count = 0;
-    nest->is_last = NULL;
+    strcpy(info->filesystem, "EXT2");
+    memcpy(info->label, sb.s_volume_name, 16);
+    info->label[16] = '\0';
+
+    info->block_size = 1024 << sb.s_log_block_size;
+    info->total_blocks = sb.s_blocks_count;
+    info->free_blocks = sb.s_free_blocks_count;
+    info->total_inodes = sb.s_inodes_count;
+    info->free_inodes = sb.s_free_inodes_count;
+    info->last_written = sb.s_wtime;
+}
+
+void EXT2_showDeepInfo(int fd) {
+
+    EXTDeepScan scan;
+    EXTGroupBitmaps total;
+    EXTFragmentation fragmentation;
+    EXTInodeList dirs;
+    EXTIdList worst;
+    EXTNameMap map;
+    EXTName *name;
+    uint64_t carried_run = 0, free_extents = 0;
+    int group_count, threads, largest_bucket = -1;
+    char *path;
+
+    memset(&scan, 0, sizeof(EXTDeepScan));
+    memset(&total, 0, sizeof(EXTGroupBitmaps));
+    memset(&fragmentation, 0, sizeof(EXTFragmentation));
+
+    scan.fd = fd;
+    scan.sb = getSuperblock(fd);
+    scan.gds = getGroupDescriptors(fd, scan.sb, &group_count);
+
+    threads = PARALLEL_getThreadCount(group_count);
+
+    scan.groups = calloc(group_count, sizeof(EXTGroupBitmaps));
+    scan.workers = calloc(threads, sizeof(EXTFragmentation));
+
+    // Every worker reads the bitmaps and inode tables of a contiguous range of block groups
+    PARALLEL_run(group_count, threads, scanGroups, &scan);
+
+    // Free runs crossing group boundaries are only known once neighbouring groups are merged
+    for (int i = 0; i < group_count; i++) {
+
+        total.free_blocks += scan.groups[i].free_blocks;
+        total.free_inodes += scan.groups[i].free_inodes;
+
+        for (int j = 0; j < FREE_RUN_BUCKETS; j++) total.free_runs[j] += scan.groups[i].free_runs[j];
+
+        if (scan.groups[i].free_blocks == scan.groups[i].total_blocks) {
+            carried_run += scan.groups[i].total_blocks;
+            continue;
+        }
+
+        addFreeRun(total.free_runs, carried_run + scan.groups[i].leading_free);
+        carried_run = scan.groups[i].trailing_free;
+    }
+
+    addFreeRun(total.free_runs, carried_run);
+
+    for (int i = 0; i < threads; i++) {
+
+        fragmentation.files += scan.workers[i].files;
+        fragmentation.fragmented_files += scan.workers[i].fragmented_files;
+        fragmentation.extents += scan.workers[i].extents;
+        fragmentation.score += scan.workers[i].score;
+
+        for (int j = 0; j < scan.workers[i].worst_count; j++) addFragment(&fragmentation, scan.workers[i].worst[j]);
+    }
+
+    printf("\nDEEP SCAN\n");
+    printf("  Free blocks: %u (superblock: %u)\n", total.free_blocks, scan.sb.s_free_blocks_count);
+    printf("  Free inodes: %u (superblock: %u)\n", total.free_inodes, scan.sb.s_free_inodes_count);
+
+    for (int i = 0; i < FREE_RUN_BUCKETS; i++) {
+
+        free_extents += total.free_runs[i];
+        if (total.free_runs[i] > 0) largest_bucket = i;
+    }
+
+    printf("  Free extents: %llu\n", (unsigned long long) free_extents);
+
+    for (int i = 0; i <= largest_bucket; i++) {
+        if (total.free_runs[i] == 0) continue;
+        printf("    %u-%u blocks: %llu\n", 1u << i, (2u << i) - 1, (unsigned long long) total.free_runs[i]);
+    }
+
+    printf("\nFRAGMENTATION\n");
+    printf("  Files: %llu\n", (unsigned long long) fragmentation.files);
+    printf("  Fragmented files: %llu\n", (unsigned long long) fragmentation.fragmented_files);
+    printf("  Extents per file: %.2f\n", fragmentation.files ? (double) fragmentation.extents / fragmentation.files : 0.0);
+    printf("  Fragmentation score: %.3f\n", fragmentation.files ? fragmentation.score / fragmentation.files : 0.0);
+
+    if (fragmentation.worst_count > 0) {
+
+        memset(&dirs, 0, sizeof(EXTInodeList));
+        memset(&worst, 0, sizeof(EXTIdList));
+
+        for (int i = 0; i < fragmentation.worst_count; i++) addId(&worst, fragmentation.worst[i].inode);
+        qsort(worst.ids, worst.count, sizeof(uint32_t), compareIds);
+
+        // Names are only needed for the handful of files being reported
+        scanInodeTables(fd, scan.sb, scan.gds, 0, group_count, 0, collectDirectory, &dirs);
+        map = buildNameMap(fd, scan.sb, &dirs, isFragmentCandidate, &worst);
+
+        printf("  Most fragmented:\n");
+
+        for (int i = 0; i < fragmentation.worst_count; i++) {
+
+            name = findName(&map, fragmentation.worst[i].inode);
+            path = (name != NULL) ? getPath(&map, name, 0) : NULL;
+
+            printf("    %s (score %.3f, %u extents)\n", (path != NULL) ? path : "?", fragmentation.worst[i].score, fragmentation.worst[i].extents);
+
+            free(path);
+        }
+
+        freeNameMap(&map);
+        free(worst.ids);
+        free(dirs.ids);
+        free(dirs.inodes);
+    }
+
+    printf("\n");
+
+    free(scan.groups);
+    free(scan.workers);
+    free(scan.gds);
+}
+
+void EXT2_showTree(int fd) {
+
+    Superblock sb;
+    GroupDescriptor *gds;
+    Tree tree;
+    int group_count, level_start, level_end;
+
+    sb = getSuperblock(fd);
+    gds = getGroupDescriptors(fd, sb, &group_count);
 
     // Start traversal at root directory (inode nº2)
-    traverseDirectory(fd, 2, NULL, nest, sb);
+    TREE_init(&tree, 2);
+
+    // Directories are loaded a whole level at a time, so their blocks can be read in image order instead of depth first
+    for (level_start = 0; level_start < tree.count && !tree.truncated; level_start = level_end) {
+        level_end = tree.count;
+        loadTreeLevel(fd, sb, gds, &tree, level_start, level_end);
+    }
+
+    TREE_print(&tree);
+
+    TREE_free(&tree);
+    free(gds);
 }
 
 int EXT2_showFile(int fd, char *file_name) {
@@ -76,7 +272,7 @@ int EXT2_showFile(int fd, char *file_name) {
     sb = getSuperblock(fd);
 
     // Start traversal at root directory (inode nº2)
-    file_inode = traverseDirectory(fd, 2, file_name, NULL, sb);
+    file_inode = traverseDirectory(fd, 2, file_name, sb);
 
     if (file_inode == NULL) {
         return -1;
@@ -89,138 +285,321 @@ int EXT2_showFile(int fd, char *file_name) {
     return 0;
 }
 
-static Superblock getSuperblock(int fd) {
+void EXT2_find(int fd, FindQuery *query) {
 
     Superblock sb;
+    GroupDescriptor *gds;
+    EXTFindScan scan;
+    EXTNameMap map;
+    char **paths = NULL, *path;
+    int group_count, total_paths = 0;
 
-    lseek(fd, SUPERBLOCK_OFFSET, SEEK_SET);
-    read(fd, &sb, SUPERBLOCK_SIZE);
-    return sb;
-}
+    sb = getSuperblock(fd);
+    gds = getGroupDescriptors(fd, sb, &group_count);
 
-static int isInternalDirectory(char* name) {
-    return strcmp(name, ".") == 0 || strcmp(name, "..") == 0 || strcmp(name, "lost+found") == 0;
-}
+    memset(&scan, 0, sizeof(EXTFindScan));
+    scan.query = query;
 
-void getBlocks(int fd, int block_id, int** blocks, int* total_blocks_fetched, int total_blocks, int block_size, int level) {
+    // Metadata predicates are evaluated on a sequential pass over every inode table
+    scanInodeTables(fd, sb, gds, 0, group_count, 0, visitFindInode, &scan);
 
-    int block_read;
+    // Names are only resolved for the inodes that matched (plus directories, to build their paths)
+    map = buildNameMap(fd, sb, &scan.dirs, isFindCandidate, &scan);
 
-    if (level > 0) {
+    for (int i = 0; i < map.count; i++) {
 
-        block_read = 0;
+        if (!containsId(&scan.matches, map.names[i].inode)) continue;
+        if (!FIND_matchesName(query, map.names[i].name)) continue;
 
-        while (block_read < block_size) {
-            
-            if (*total_blocks_fetched == total_blocks) return;
+        path = getPath(&map, &map.names[i], 0);
+        if (path == NULL) continue;
 
-            lseek(fd, block_id * block_size + block_read, SEEK_SET);
-            read(fd, &block_id, 4);
-            getBlocks(fd, block_id, blocks, total_blocks_fetched, total_blocks, block_size, level - 1);
-            block_read += 4;
-        }
+        paths = realloc(paths, sizeof(char*) * (total_paths + 1));
+        paths[total_paths++] = path;
     }
-    else if (*total_blocks_fetched < total_blocks) {
 
-        *blocks = realloc(*blocks, sizeof(int) * (*total_blocks_fetched + 1));
-        *blocks[*total_blocks_fetched] = block_id;
+    qsort(paths, total_paths, sizeof(char*), comparePaths);
 
-        (*total_blocks_fetched)++;
+    for (int i = 0; i < total_paths; i++) {
+        printf("%s\n", paths[i]);
+        free(paths[i]);
     }
+
+    free(paths);
+    freeNameMap(&map);
+    free(scan.matches.ids);
+    free(scan.dirs.ids);
+    free(scan.dirs.inodes);
+    free(gds);
 }
 
-static int isLastEntry(int fd, int *next_entry, int *blocks, int *current_block, int total_blocks, int block_size) {
+void EXT2_showUsage(int fd, int top) {
 
-    EXTDirectoryEntry dir_entry;
-    char *name = NULL;
-    int check;
+    Superblock sb;
+    GroupDescriptor *gds;
+    EXTUsageScan scan;
+    EXTNameMap map;
+    EXTName *name;
+    EXTUsage *usage, *totals, *direct;
+    DUReport report;
+    uint32_t parent;
+    int group_count, dir_index, depth;
+    char *path;
+
+    sb = getSuperblock(fd);
+    gds = getGroupDescriptors(fd, sb, &group_count);
 
-    do { 
+    memset(&scan, 0, sizeof(EXTUsageScan));
+    memset(&report, 0, sizeof(DUReport));
 
-        if (*next_entry % block_size == 0 && *current_block == total_blocks) {
-            free(name);
-            return 1;
-        }
+    // Sizes come from one sequential pass over the inode tables, names only give the parent of each inode
+    scanInodeTables(fd, sb, gds, 0, group_count, 0, visitUsageInode, &scan);
+    map = buildNameMap(fd, sb, &scan.dirs, isAnyEntry, NULL);
 
-        lseek(fd, *next_entry, SEEK_SET);
-        read(fd, &dir_entry, DIR_ENTRY_SIZE);
+    totals = calloc(scan.dirs.count, sizeof(EXTUsage));
+    direct = calloc(scan.dirs.count, sizeof(EXTUsage));
 
-        name = realloc(name, dir_entry.name_len + 1);
-        read(fd, name, dir_entry.name_len);
-        name[dir_entry.name_len] = '\0';
+    // Every directory starts with its own blocks
+    for (int i = 0; i < scan.dirs.count; i++) {
 
-        *next_entry += dir_entry.rec_len;
+        usage = findUsage(&scan, scan.dirs.ids[i]);
+        if (usage != NULL) direct[i] = *usage;
+    }
 
-        check = 1;
+    // Files are added to the directory holding them, hard links only once
+    for (int i = 0; i < map.count; i++) {
 
-        if (*next_entry % block_size == 0) {
-            
-            if (*current_block < total_blocks) {
-                *next_entry = block_size * blocks[*current_block];
-                (*current_block)++;
+        if (i > 0 && map.names[i].inode == map.names[i - 1].inode) continue;
+        if (findIndex(scan.dirs.ids, scan.dirs.count, map.names[i].inode) >= 0) continue;
+
+        usage = findUsage(&scan, map.names[i].inode);
+        dir_index = findIndex(scan.dirs.ids, scan.dirs.count, map.names[i].parent);
+
+        if (usage == NULL || dir_index < 0) continue;
+
+        direct[dir_index].size += usage->size;
+        direct[dir_index].allocated += usage->allocated;
+    }
+
+    // Each directory's own total then rolls up into every ancestor
+    for (int i = 0; i < scan.dirs.count; i++) {
+
+        totals[i].size += direct[i].size;
+        totals[i].allocated += direct[i].allocated;
 
-                check = 0;
+        name = findName(&map, scan.dirs.ids[i]);
+
+        for (depth = 0; name != NULL && depth < 4096; depth++) {
+
+            parent = name->parent;
+            dir_index = findIndex(scan.dirs.ids, scan.dirs.count, parent);
+
+            if (dir_index >= 0) {
+                totals[dir_index].size += direct[i].size;
+                totals[dir_index].allocated += direct[i].allocated;
             }
+
+            if (parent == 2) break;
+            name = findName(&map, parent);
         }
+    }
 
-    } while (dir_entry.inode == 0 || isInternalDirectory(name));
+    for (int i = 0; i < scan.dirs.count; i++) {
 
-    if (check) *next_entry -= dir_entry.rec_len;
+        if (scan.dirs.ids[i] == 2) {
+            path = strdup("/");
+        }
+        else {
+            name = findName(&map, scan.dirs.ids[i]);
+            path = (name != NULL) ? getPath(&map, name, 0) : NULL;
+        }
 
-    free(name);
+        if (path == NULL) continue;
 
-    return 0;
+        DU_add(&report, path, totals[i].size, totals[i].allocated);
+    }
+
+    DU_print(&report, top);
+
+    DU_free(&report);
+    freeNameMap(&map);
+    free(totals);
+    free(direct);
+    free(scan.usage);
+    free(scan.dirs.ids);
+    free(scan.dirs.inodes);
+    free(gds);
 }
 
-static char* getNestFormat(EXTNest nest) {
+int EXT2_checkConsistency(int fd) {
 
-    char* nesting;
-    int i = 0, nest_i = 0;
+    EXTCheckScan scan;
+    CheckLog log;
+    int group_count, threads, problems;
 
-    if (nest.count == 0) return NULL;
+    memset(&scan, 0, sizeof(EXTCheckScan));
+    memset(&log, 0, sizeof(CheckLog));
 
-    nesting = malloc((nest.count * 4) + 1);
+    scan.fd = fd;
+    scan.sb = getSuperblock(fd);
+    scan.gds = getGroupDescriptors(fd, scan.sb, &group_count);
 
-    for (i = 0, nest_i = 0; nest_i < nest.count; nest_i++, i++) {
+    threads = PARALLEL_getThreadCount(group_count);
 
-        if (!nest.is_last[nest_i]) {
-            nesting[i] = 0xE2;
-            nesting[i + 1] = 0x94;
-            nesting[i + 2] = 0x82;
-            i += 3;
-        }
+    scan.block_refs = calloc(scan.sb.s_blocks_count, sizeof(uint8_t));
+    scan.link_refs = calloc(scan.sb.s_inodes_count + 1, sizeof(uint16_t));
+    scan.link_counts = calloc(scan.sb.s_inodes_count + 1, sizeof(uint16_t));
+    scan.logs = calloc(threads, sizeof(CheckLog));
+
+    markMetadataBlocks(&scan, group_count);
+
+    // First pass references every block and inode from the inode tables and directories of each group range
+    PARALLEL_run(group_count, threads, checkInodes, &scan);
+
+    // Second pass compares those references with each group's bitmap and link counts
+    PARALLEL_run(group_count, threads, checkGroups, &scan);
+
+    for (int i = 0; i < threads; i++) {
+        CHECK_merge(&log, &scan.logs[i]);
+    }
+
+    printf("\n------ Consistency Check ------\n\n");
+    printf("Filesystem: EXT2\n\n");
+    problems = CHECK_print(&log);
+
+    CHECK_free(&log);
+    free(scan.logs);
+    free(scan.block_refs);
+    free(scan.link_refs);
+    free(scan.link_counts);
+    free(scan.gds);
+
+    return problems;
+}
+
+void EXT2_listFiles(int fd, FileList *list) {
+
+    Superblock sb;
+    GroupDescriptor *gds;
+    EXTListScan scan;
+    EXTNameMap map;
+    FileEntry *entry;
+    Inode *inode;
+    int group_count, inode_index, is_dir;
+    char *path;
+
+    sb = getSuperblock(fd);
+    gds = getGroupDescriptors(fd, sb, &group_count);
+
+    memset(&scan, 0, sizeof(EXTListScan));
+
+    scanInodeTables(fd, sb, gds, 0, group_count, 0, collectListInode, &scan);
+    map = buildNameMap(fd, sb, &scan.dirs, isAnyEntry, NULL);
+
+    // Every name is listed, so hard links show up once per path
+    for (int i = 0; i < map.count; i++) {
+
+        inode_index = findIndex(scan.inodes.ids, scan.inodes.count, map.names[i].inode);
+        if (inode_index < 0) continue;
+
+        path = getPath(&map, &map.names[i], 0);
+        if (path == NULL) continue;
+
+        inode = &scan.inodes.inodes[inode_index];
+        is_dir = (inode->i_mode & 0xF000) == 0x4000;
 
-        nesting[i] = '\t';
+        entry = FILELIST_add(list, path, is_dir ? 0 : getFileSize(inode), inode->i_mtime, is_dir);
+
+        if ((inode->i_mode & 0xF000) == 0x8000) mapInodeExtents(fd, inode, 1024 << sb.s_log_block_size, entry);
+    }
+
+    freeNameMap(&map);
+    free(scan.inodes.ids);
+    free(scan.inodes.inodes);
+    free(scan.dirs.ids);
+    free(scan.dirs.inodes);
+    free(gds);
+}
+
+void EXT2_watch(int fd, int interval) {
+
+    EXTWatch watch;
+
+    memset(&watch, 0, sizeof(EXTWatch));
+
+    watch.fd = fd;
+    watch.sb = getSuperblock(fd);
+    watch.gds = getGroupDescriptors(fd, watch.sb, &watch.group_count);
+    watch.table_blocks = (watch.sb.s_inodes_per_group * watch.sb.s_inode_size + (1024 << watch.sb.s_log_block_size) - 1) / (1024 << watch.sb.s_log_block_size);
+
+    loadWatchGroups(&watch);
+
+    watch.tree.list = listWatchDirectory;
+    watch.tree.ctx = &watch;
+    WATCH_load(&watch.tree, 2);
+
+    // Runs until interrupted, printing only what changed between polls
+    while (1) {
+
+        sleep(interval);
+
+        pollChanges(&watch);
+        fflush(stdout);
     }
+}
+
+static Superblock getSuperblock(int fd) {
 
-    nesting[i] = '\0';
+    Superblock sb;
+
+    IMAGE_lseek(fd, SUPERBLOCK_OFFSET, SEEK_SET);
+    IMAGE_read(fd, &sb, SUPERBLOCK_SIZE);
+    return sb;
+}
 
-    return realloc(nesting, strlen(nesting) + 1);
+static int isInternalDirectory(char* name) {
+    return strcmp(name, ".") == 0 || strcmp(name, "..") == 0 || strcmp(name, "lost+found") == 0;
 }
 
-static EXTNest* clone(EXTNest *nest, int is_last) {
+void getBlocks(int fd, int block_id, int** blocks, int* total_blocks_fetched, int total_blocks, int block_size, int level) {
+
+    int block_read, child_id;
 
-    EXTNest *nest_copy = malloc(sizeof(EXTNest));
+    // Unused pointers, and the zeroed tail of an indirect block
+    if (block_id == 0) return;
 
-    nest_copy->count = nest->count + 1;
-    nest_copy->is_last = malloc(nest_copy->count * sizeof(int));
+    if (level > 0) {
+
+        block_read = 0;
+
+        while (block_read < block_size) {
+            
+            if (*total_blocks_fetched == total_blocks) return;
 
-    for (int i = 0; i < nest->count; i++) {
-        nest_copy->is_last[i] = nest->is_last[i];
+            // Children are read into their own variable, the indirect block's id is needed for every pointer
+            IMAGE_lseek(fd, (off_t) block_id * block_size + block_read, SEEK_SET);
+            IMAGE_read(fd, &child_id, 4);
+            getBlocks(fd, child_id, blocks, total_blocks_fetched, total_blocks, block_size, level - 1);
+            block_read += 4;
+        }
     }
-    nest_copy->is_last[nest->count] = is_last;
+    else if (*total_blocks_fetched < total_blocks) {
+
+        *blocks = realloc(*blocks, sizeof(int) * (*total_blocks_fetched + 1));
+        (*blocks)[*total_blocks_fetched] = block_id;
 
-    return nest_copy;
+        (*total_blocks_fetched)++;
+    }
 }
 
-static Inode* traverseDirectory(int fd, int inode_id, char *file_name, EXTNest *nest, Superblock sb) {
+static Inode* traverseDirectory(int fd, int inode_id, char *file_name, Superblock sb) {
 
     GroupDescriptor gd;
     Inode inode, *ret_inode;
     EXTDirectoryEntry dir_entry;
     int block_size, block_group_index, inode_table_index, block_group_desc, directory_entry, current_block, total_blocks, is_last = 0;
     int *blocks = NULL, total_blocks_fetched = 0;
-    char *name = NULL, *nesting;
+    char *name = NULL;
 
     block_size = 1024 << sb.s_log_block_size;
 
@@ -230,18 +609,18 @@ static Inode* traverseDirectory(int fd, int inode_id, char *file_name, EXTNest *
     block_group_desc = (block_size * (sb.s_first_data_block + 1)) + (block_group_index * 32);
 
     // Get inode's block group descriptor
-    lseek(fd, block_group_desc, SEEK_SET);
-    read(fd, &gd, GROUP_DESC_SIZE);
+    IMAGE_lseek(fd, block_group_desc, SEEK_SET);
+    IMAGE_read(fd, &gd, GROUP_DESC_SIZE);
 
     // Point to inode table
-    lseek(fd, block_size * gd.bg_inode_table, SEEK_SET);
+    IMAGE_lseek(fd, block_size * gd.bg_inode_table, SEEK_SET);
 
     // Get inode's table index knowing inode id and nº of inodes per block group
     inode_table_index = (inode_id - 1) % sb.s_inodes_per_group;
 
     // Get corresponding inode table entry
-    lseek(fd, sb.s_inode_size * inode_table_index, SEEK_CUR);
-    read(fd, &inode, INODE_SIZE);
+    IMAGE_lseek(fd, sb.s_inode_size * inode_table_index, SEEK_CUR);
+    IMAGE_read(fd, &inode, INODE_SIZE);
 
     // Prepare inode's blocks
     total_blocks = inode.i_blocks / (block_size / 512);
@@ -253,23 +632,32 @@ static Inode* traverseDirectory(int fd, int inode_id, char *file_name, EXTNest *
     getBlocks(fd, inode.i_block[13], &blocks, &total_blocks_fetched, total_blocks, block_size, 2);
     getBlocks(fd, inode.i_block[14], &blocks, &total_blocks_fetched, total_blocks, block_size, 3);
 
+    // i_blocks counts indirect blocks too, so only the data blocks actually fetched are walked
+    if (total_blocks_fetched == 0) {
+        free(blocks);
+        return NULL;
+    }
+
     current_block = 0;
     directory_entry = block_size * blocks[current_block++];
 
     do {
 
-        lseek(fd, directory_entry, SEEK_SET);
-        read(fd, &dir_entry, DIR_ENTRY_SIZE);
+        IMAGE_lseek(fd, directory_entry, SEEK_SET);
+        IMAGE_read(fd, &dir_entry, DIR_ENTRY_SIZE);
+
+        // A damaged entry would never reach the end of its block
+        if (dir_entry.rec_len < DIR_ENTRY_SIZE) break;
 
         name = (char*) malloc(dir_entry.name_len + 1);
-        read(fd, name, dir_entry.name_len);
+        IMAGE_read(fd, name, dir_entry.name_len);
         name[dir_entry.name_len] = '\0';
 
         directory_entry += dir_entry.rec_len;
 
         if (directory_entry % block_size == 0) {
             
-            if (current_block < total_blocks) {
+            if (current_block < total_blocks_fetched) {
                 
                 directory_entry = block_size * blocks[current_block];
                 current_block++;
@@ -284,47 +672,30 @@ static Inode* traverseDirectory(int fd, int inode_id, char *file_name, EXTNest *
             continue;
         }
 
-        if (nest != NULL) {
-        
-            nesting = getNestFormat(*nest);
-
-            if (isLastEntry(fd, &directory_entry, blocks, &current_block, total_blocks, block_size)) {
-                printf("%s└ %s\n", (nesting != NULL) ? nesting : "", name);
-                is_last = 1;
-            }
-            else {
-                printf("%s├ %s\n", (nesting != NULL) ? nesting : "", name);
-                is_last = 0;
-            }
-
-            if (nesting != NULL) free(nesting);
-        }
-
         if (dir_entry.file_type == 2) {
 
-            if (nest != NULL) {
-                traverseDirectory(fd, dir_entry.inode, NULL, clone(nest, is_last), sb);
-            }
-            else {
-                ret_inode = traverseDirectory(fd, dir_entry.inode, file_name, NULL, sb);
+            ret_inode = traverseDirectory(fd, dir_entry.inode, file_name, sb);
 
-                if (ret_inode != NULL) {
-                    free(name);
-                    free(blocks);
-                    return ret_inode;
-                }
+            if (ret_inode != NULL) {
+                free(name);
+                free(blocks);
+                return ret_inode;
             }
         }
-        else if (file_name != NULL && strcmp(file_name, name) == 0) {
+        else if (strcmp(file_name, name) == 0) {
+
+            // The file's inode can sit in another group than its directory's
+            IMAGE_lseek(fd, (block_size * (sb.s_first_data_block + 1)) + ((dir_entry.inode - 1) / sb.s_inodes_per_group) * 32, SEEK_SET);
+            IMAGE_read(fd, &gd, GROUP_DESC_SIZE);
 
-            lseek(fd, block_size * gd.bg_inode_table, SEEK_SET);
+            IMAGE_lseek(fd, block_size * gd.bg_inode_table, SEEK_SET);
 
             inode_table_index = (dir_entry.inode - 1) % sb.s_inodes_per_group;
 
-            lseek(fd, sb.s_inode_size * inode_table_index, SEEK_CUR);
+            IMAGE_lseek(fd, sb.s_inode_size * inode_table_index, SEEK_CUR);
 
             ret_inode = malloc(INODE_SIZE);
-            read(fd, ret_inode, INODE_SIZE);
+            IMAGE_read(fd, ret_inode, INODE_SIZE);
 
             free(name);
             free(blocks);
@@ -335,8 +706,6 @@ static Inode* traverseDirectory(int fd, int inode_id, char *file_name, EXTNest *
 
     } while (!is_last);
 
-    if (nest != NULL) free(nest->is_last);
-    free(nest);
     free(blocks);
     return NULL;
 }
@@ -344,7 +713,29 @@ static Inode* traverseDirectory(int fd, int inode_id, char *file_name, EXTNest *
 void printBlockData(int fd, int block_id, long *bytes_read, long file_size, int block_size, int level) {
 
     char* data = NULL;
-    int bytes_to_read, block_read;
+    int bytes_to_read, block_read, child_id;
+    long hole_size;
+
+    if (*bytes_read >= file_size) return;
+
+    // A missing block is a hole, which reads as zeros for everything below it
+    if (block_id == 0) {
+
+        hole_size = block_size;
+        for (int i = 0; i < level; i++) hole_size *= block_size / 4;
+        if (hole_size > file_size - *bytes_read) hole_size = file_size - *bytes_read;
+
+        data = calloc(block_size, 1);
+
+        for (long written = 0; written < hole_size; written += block_size) {
+            fwrite(data, 1, (hole_size - written < block_size) ? hole_size - written : block_size, stdout);
+        }
+
+        *bytes_read += hole_size;
+
+        free(data);
+        return;
+    }
 
     if (level > 0) {
 
@@ -354,24 +745,24 @@ void printBlockData(int fd, int block_id, long *bytes_read, long file_size, int
             
             if (file_size == *bytes_read) return;
 
-            lseek(fd, block_id * block_size + block_read, SEEK_SET);
-            read(fd, &block_id, 4);
-            printBlockData(fd, block_id, bytes_read, file_size, block_size, level - 1);
+            IMAGE_lseek(fd, (off_t) block_id * block_size + block_read, SEEK_SET);
+            IMAGE_read(fd, &child_id, 4);
+            printBlockData(fd, child_id, bytes_read, file_size, block_size, level - 1);
             block_read += 4;
         }
     }
     else {
 
-        lseek(fd, block_id * block_size, SEEK_SET);
+        IMAGE_lseek(fd, block_id * block_size, SEEK_SET);
 
         bytes_to_read = (file_size - *bytes_read < block_size) ? file_size - *bytes_read : block_size;
 
         if (!bytes_to_read) return;
 
-        data = malloc(bytes_to_read + 1);
-        read(fd, data, bytes_to_read);
-        data[bytes_to_read] = '\0';
-        printf("%s", data);
+        // Written as is, files can hold zero bytes
+        data = malloc(bytes_to_read);
+        IMAGE_read(fd, data, bytes_to_read);
+        fwrite(data, 1, bytes_to_read, stdout);
 
         *bytes_read += bytes_to_read;
 
@@ -403,4 +794,1512 @@ static void showFile(int fd, Inode* inode, Superblock sb) {
     printBlockData(fd, inode->i_block[13], &bytes_read, file_size, block_size, 2);
 
     printBlockData(fd, inode->i_block[14], &bytes_read, file_size, block_size, 3);
-}
\ No newline at end of file
+}
+
+static uint64_t getFileSize(Inode *inode) {
+
+    uint64_t file_size;
+
+    // Regular files keep the upper 32 bits of their size in i_dir_acl
+    file_size = ((inode->i_mode & 0xF000) == 0x8000) ? inode->i_dir_acl : 0;
+    file_size <<= 32;
+
+    return file_size | inode->i_size;
+}
+
+static int getGroupCount(Superblock sb) {
+    return (sb.s_blocks_count - sb.s_first_data_block + sb.s_blocks_per_group - 1) / sb.s_blocks_per_group;
+}
+
+static GroupDescriptor* getGroupDescriptors(int fd, Superblock sb, int *group_count) {
+
+    GroupDescriptor *gds;
+    int block_size;
+
+    block_size = 1024 << sb.s_log_block_size;
+    *group_count = getGroupCount(sb);
+
+    // Block group descriptor table is always at the block following superblock
+    gds = malloc(*group_count * GROUP_DESC_SIZE);
+    IMAGE_pread(fd, gds, *group_count * GROUP_DESC_SIZE, (off_t) block_size * (sb.s_first_data_block + 1));
+
+    return gds;
+}
+
+static void scanInodeTables(int fd, Superblock sb, GroupDescriptor *gds, int first_group, int last_group, int reserved, void (*visit)(uint32_t inode_id, Inode *inode, void *ctx), void *ctx) {
+
+    uint8_t *bitmap, *table;
+    uint32_t inode_id, first_inode;
+    int block_size, used_inodes;
+
+    block_size = 1024 << sb.s_log_block_size;
+    first_inode = (sb.s_rev_level == 0) ? 11 : sb.s_first_ino;
+
+    bitmap = malloc(block_size);
+    table = malloc(sb.s_inodes_per_group * sb.s_inode_size);
+
+    for (int group = first_group; group < last_group; group++) {
+
+        // The bitmap decides, free counts in the descriptors go stale after an unclean unmount
+        IMAGE_pread(fd, bitmap, block_size, (off_t) block_size * gds[group].bg_inode_bitmap);
+
+        // Only read the inode table up to its last allocated inode, groups without any are not read at all
+        for (used_inodes = sb.s_inodes_per_group; used_inodes > 0; used_inodes--) {
+            if (bitmap[(used_inodes - 1) / 8] & (1 << ((used_inodes - 1) % 8))) break;
+        }
+
+        if (used_inodes == 0) continue;
+
+        IMAGE_pread(fd, table, used_inodes * sb.s_inode_size, (off_t) block_size * gds[group].bg_inode_table);
+
+        for (int i = 0; i < used_inodes; i++) {
+
+            if (!(bitmap[i / 8] & (1 << (i % 8)))) continue;
+
+            inode_id = group * sb.s_inodes_per_group + i + 1;
+
+            // Reserved inodes other than the root directory hold filesystem metadata
+            if (!reserved && inode_id < first_inode && inode_id != 2) continue;
+
+            visit(inode_id, (Inode*) (table + i * sb.s_inode_size), ctx);
+        }
+    }
+
+    free(bitmap);
+    free(table);
+}
+
+static void walkBlocks(int fd, uint32_t block_id, int level, int block_size, void (*visit)(uint32_t block_id, int level, void *ctx), void *ctx) {
+
+    uint32_t *entries;
+
+    if (block_id == 0) return;
+
+    visit(block_id, level, ctx);
+
+    if (level == 0) return;
+
+    // Zeroed, so a block past the end of the image reads as an empty indirect block
+    entries = calloc(block_size, 1);
+    IMAGE_pread(fd, entries, block_size, (off_t) block_id * block_size);
+
+    for (int i = 0; i < block_size / 4; i++) {
+        walkBlocks(fd, entries[i], level - 1, block_size, visit, ctx);
+    }
+
+    free(entries);
+}
+
+static void walkInodeBlocks(int fd, Inode *inode, int block_size, void (*visit)(uint32_t block_id, int level, void *ctx), void *ctx) {
+
+    // Fast symlinks keep their target inside i_block instead of block pointers
+    if (inode->i_blocks == 0) return;
+
+    for (int i = 0; i < 12; i++) {
+        walkBlocks(fd, inode->i_block[i], 0, block_size, visit, ctx);
+    }
+    walkBlocks(fd, inode->i_block[12], 1, block_size, visit, ctx);
+    walkBlocks(fd, inode->i_block[13], 2, block_size, visit, ctx);
+    walkBlocks(fd, inode->i_block[14], 3, block_size, visit, ctx);
+}
+
+static void addId(EXTIdList *list, uint32_t id) {
+
+    if (list->count == list->capacity) {
+        list->capacity = (list->capacity == 0) ? 64 : list->capacity * 2;
+        list->ids = realloc(list->ids, sizeof(uint32_t) * list->capacity);
+    }
+
+    list->ids[list->count++] = id;
+}
+
+static void addInode(EXTInodeList *list, uint32_t id, Inode *inode) {
+
+    if (list->count == list->capacity) {
+        list->capacity = (list->capacity == 0) ? 64 : list->capacity * 2;
+        list->ids = realloc(list->ids, sizeof(uint32_t) * list->capacity);
+        list->inodes = realloc(list->inodes, sizeof(Inode) * list->capacity);
+    }
+
+    list->ids[list->count] = id;
+    memcpy(&list->inodes[list->count], inode, INODE_SIZE);
+    list->count++;
+}
+
+static void addDataBlock(uint32_t block_id, int level, void *ctx) {
+    if (level == 0) addId((EXTIdList*) ctx, block_id);
+}
+
+static int findIndex(uint32_t *ids, int count, uint32_t id) {
+
+    int low = 0, high = count - 1, middle;
+
+    // Lists built from an inode table scan are already sorted
+    while (low <= high) {
+
+        middle = (low + high) / 2;
+
+        if (ids[middle] == id) return middle;
+
+        if (ids[middle] < id) low = middle + 1;
+        else high = middle - 1;
+    }
+
+    return -1;
+}
+
+static int containsId(EXTIdList *list, uint32_t id) {
+    return findIndex(list->ids, list->count, id) >= 0;
+}
+
+static int compareNames(const void *a, const void *b) {
+
+    const EXTName *name_a = a, *name_b = b;
+
+    if (name_a->inode != name_b->inode) return (name_a->inode < name_b->inode) ? -1 : 1;
+    if (name_a->parent != name_b->parent) return (name_a->parent < name_b->parent) ? -1 : 1;
+    return strcmp(name_a->name, name_b->name);
+}
+
+static EXTNameMap buildNameMap(int fd, Superblock sb, EXTInodeList *dirs, int (*wanted)(uint32_t inode_id, int is_dir, void *ctx), void *ctx) {
+
+    EXTNameMap map;
+    EXTIdList blocks;
+    EXTDirectoryEntry *dir_entry;
+    EXTName *name;
+    uint8_t *data;
+    int block_size, offset;
+
+    block_size = 1024 << sb.s_log_block_size;
+
+    map.count = 0;
+    map.capacity = 0;
+    map.names = NULL;
+    data = malloc(block_size);
+
+    for (int i = 0; i < dirs->count; i++) {
+
+        memset(&blocks, 0, sizeof(EXTIdList));
+        walkInodeBlocks(fd, &dirs->inodes[i], block_size, addDataBlock, &blocks);
+
+        for (int j = 0; j < blocks.count; j++) {
+
+            IMAGE_pread(fd, data, block_size, (off_t) blocks.ids[j] * block_size);
+
+            for (offset = 0; offset + DIR_ENTRY_SIZE <= block_size; offset += dir_entry->rec_len) {
+
+                dir_entry = (EXTDirectoryEntry*) (data + offset);
+
+                if (dir_entry->rec_len < DIR_ENTRY_SIZE) break;
+                if (dir_entry->inode == 0 || offset + DIR_ENTRY_SIZE + dir_entry->name_len > block_size) continue;
+
+                // Self and parent links would make every directory its own ancestor
+                if (dir_entry->name_len == 1 && data[offset + DIR_ENTRY_SIZE] == '.') continue;
+                if (dir_entry->name_len == 2 && data[offset + DIR_ENTRY_SIZE] == '.' && data[offset + DIR_ENTRY_SIZE + 1] == '.') continue;
+
+                if (!wanted(dir_entry->inode, dir_entry->file_type == 2, ctx)) continue;
+
+                if (map.count == map.capacity) {
+                    map.capacity = (map.capacity == 0) ? 64 : map.capacity * 2;
+                    map.names = realloc(map.names, sizeof(EXTName) * map.capacity);
+                }
+
+                name = &map.names[map.count++];
+
+                name->inode = dir_entry->inode;
+                name->parent = dirs->ids[i];
+                name->name = malloc(dir_entry->name_len + 1);
+                memcpy(name->name, data + offset + DIR_ENTRY_SIZE, dir_entry->name_len);
+                name->name[dir_entry->name_len] = '\0';
+            }
+        }
+
+        free(blocks.ids);
+    }
+
+    free(data);
+
+    qsort(map.names, map.count, sizeof(EXTName), compareNames);
+
+    return map;
+}
+
+static EXTName* findName(EXTNameMap *map, uint32_t inode_id) {
+
+    int low = 0, high = map->count - 1, middle;
+
+    // Lower bound, so hard links always resolve through the same name
+    while (low < high) {
+
+        middle = (low + high) / 2;
+
+        if (map->names[middle].inode < inode_id) low = middle + 1;
+        else high = middle;
+    }
+
+    if (map->count == 0 || map->names[low].inode != inode_id) return NULL;
+
+    return &map->names[low];
+}
+
+static char* getPath(EXTNameMap *map, EXTName *name, int depth) {
+
+    EXTName *parent;
+    char *parent_path, *path;
+
+    // Root directory (inode nº2) is the end of every path
+    if (name->parent == 2) {
+        parent_path = NULL;
+    }
+    else {
+
+        parent = findName(map, name->parent);
+
+        // Orphaned or looping entries can't be given a path
+        if (parent == NULL || depth > 4096) return NULL;
+
+        parent_path = getPath(map, parent, depth + 1);
+        if (parent_path == NULL) return NULL;
+    }
+
+    path = malloc(((parent_path != NULL) ? strlen(parent_path) : 0) + strlen(name->name) + 2);
+    sprintf(path, "%s/%s", (parent_path != NULL) ? parent_path : "", name->name);
+
+    free(parent_path);
+
+    return path;
+}
+
+static void freeNameMap(EXTNameMap *map) {
+
+    for (int i = 0; i < map->count; i++) {
+        free(map->names[i].name);
+    }
+
+    free(map->names);
+    map->names = NULL;
+    map->count = 0;
+    map->capacity = 0;
+}
+
+static void visitFindInode(uint32_t inode_id, Inode *inode, void *ctx) {
+
+    EXTFindScan *scan = ctx;
+    int is_dir;
+
+    is_dir = (inode->i_mode & 0xF000) == 0x4000;
+
+    if (is_dir) addInode(&scan->dirs, inode_id, inode);
+
+    if (FIND_matchesMetadata(scan->query, getFileSize(inode), inode->i_mtime, is_dir)) {
+        addId(&scan->matches, inode_id);
+    }
+}
+
+static int isFindCandidate(uint32_t inode_id, int is_dir, void *ctx) {
+
+    EXTFindScan *scan = ctx;
+
+    return is_dir || containsId(&scan->matches, inode_id);
+}
+
+static int comparePaths(const void *a, const void *b) {
+    return strcmp(*(char**) a, *(char**) b);
+}
+
+static void visitUsageInode(uint32_t inode_id, Inode *inode, void *ctx) {
+
+    EXTUsageScan *scan = ctx;
+
+    if ((inode->i_mode & 0xF000) == 0x4000) addInode(&scan->dirs, inode_id, inode);
+
+    if (scan->count == scan->capacity) {
+        scan->capacity = (scan->capacity == 0) ? 64 : scan->capacity * 2;
+        scan->usage = realloc(scan->usage, sizeof(EXTUsage) * scan->capacity);
+    }
+
+    // i_blocks counts 512-byte sectors, indirect blocks included
+    scan->usage[scan->count].inode = inode_id;
+    scan->usage[scan->count].size = getFileSize(inode);
+    scan->usage[scan->count].allocated = (uint64_t) inode->i_blocks * 512;
+    scan->count++;
+}
+
+static int isAnyEntry(uint32_t inode_id, int is_dir, void *ctx) {
+
+    (void) inode_id;
+    (void) is_dir;
+    (void) ctx;
+
+    return 1;
+}
+
+static int compareUsageInodes(const void *a, const void *b) {
+
+    const EXTUsage *usage_a = a, *usage_b = b;
+
+    if (usage_a->inode == usage_b->inode) return 0;
+    return (usage_a->inode < usage_b->inode) ? -1 : 1;
+}
+
+static EXTUsage* findUsage(EXTUsageScan *scan, uint32_t inode_id) {
+
+    EXTUsage key;
+
+    key.inode = inode_id;
+
+    return bsearch(&key, scan->usage, scan->count, sizeof(EXTUsage), compareUsageInodes);
+}
+
+static int compareIds(const void *a, const void *b) {
+
+    uint32_t id_a = *(const uint32_t*) a, id_b = *(const uint32_t*) b;
+
+    if (id_a == id_b) return 0;
+    return (id_a < id_b) ? -1 : 1;
+}
+
+static void collectDirectory(uint32_t inode_id, Inode *inode, void *ctx) {
+    if ((inode->i_mode & 0xF000) == 0x4000) addInode((EXTInodeList*) ctx, inode_id, inode);
+}
+
+static uint32_t countUsedBits(uint8_t *bitmap, uint32_t total_bits) {
+
+    uint64_t word;
+    uint32_t used = 0, i;
+
+    // Population count a whole 64-bit word at a time
+    for (i = 0; i + 64 <= total_bits; i += 64) {
+        memcpy(&word, bitmap + i / 8, 8);
+        used += __builtin_popcountll(word);
+    }
+
+    for (; i < total_bits; i++) {
+        if (bitmap[i / 8] & (1 << (i % 8))) used++;
+    }
+
+    return used;
+}
+
+static void addFreeRun(uint64_t *free_runs, uint32_t length) {
+
+    int bucket = 0;
+
+    if (length == 0) return;
+
+    // Bucket i holds runs of 2^i to 2^(i+1)-1 blocks
+    while (bucket < FREE_RUN_BUCKETS - 1 && (length >> (bucket + 1)) != 0) bucket++;
+
+    free_runs[bucket]++;
+}
+
+static void countFreeRuns(uint8_t *bitmap, EXTGroupBitmaps *group) {
+
+    uint64_t word;
+    uint32_t run = 0, i = 0;
+    int leading = 1;
+
+    while (i < group->total_blocks) {
+
+        // Whole words of free blocks are skipped at once
+        if (i % 64 == 0 && i + 64 <= group->total_blocks) {
+
+            memcpy(&word, bitmap + i / 8, 8);
+
+            if (word == 0) {
+                run += 64;
+                i += 64;
+                continue;
+            }
+        }
+
+        if (bitmap[i / 8] & (1 << (i % 8))) {
+
+            // Runs touching the group start may continue from the previous group
+            if (leading) group->leading_free = run;
+            else addFreeRun(group->free_runs, run);
+
+            leading = 0;
+            run = 0;
+        }
+        else {
+            run++;
+        }
+
+        i++;
+    }
+
+    group->trailing_free = run;
+    if (leading) group->leading_free = run;
+}
+
+static void scanGroups(int worker, int begin, int end, void *ctx) {
+
+    EXTDeepScan *scan = ctx, worker_scan;
+    EXTGroupBitmaps *group;
+    uint8_t *bitmap;
+    int block_size;
+
+    block_size = 1024 << scan->sb.s_log_block_size;
+    bitmap = malloc(block_size);
+
+    for (int i = begin; i < end; i++) {
+
+        group = &scan->groups[i];
+
+        // Last group may be shorter than the rest
+        group->total_blocks = scan->sb.s_blocks_count - scan->sb.s_first_data_block - i * scan->sb.s_blocks_per_group;
+        if (group->total_blocks > scan->sb.s_blocks_per_group) group->total_blocks = scan->sb.s_blocks_per_group;
+
+        IMAGE_pread(scan->fd, bitmap, block_size, (off_t) block_size * scan->gds[i].bg_block_bitmap);
+        group->free_blocks = group->total_blocks - countUsedBits(bitmap, group->total_blocks);
+        countFreeRuns(bitmap, group);
+
+        IMAGE_pread(scan->fd, bitmap, block_size, (off_t) block_size * scan->gds[i].bg_inode_bitmap);
+        group->free_inodes = scan->sb.s_inodes_per_group - countUsedBits(bitmap, scan->sb.s_inodes_per_group);
+    }
+
+    free(bitmap);
+
+    worker_scan = *scan;
+    worker_scan.worker = worker;
+
+    scanInodeTables(scan->fd, scan->sb, scan->gds, begin, end, 0, visitFragmentInode, &worker_scan);
+}
+
+static void visitFragmentInode(uint32_t inode_id, Inode *inode, void *ctx) {
+
+    EXTDeepScan *scan = ctx;
+    EXTFragmentation *fragmentation;
+    EXTFragment fragment;
+    EXTIdList blocks;
+
+    if ((inode->i_mode & 0xF000) != 0x8000) return;
+
+    memset(&blocks, 0, sizeof(EXTIdList));
+    walkInodeBlocks(scan->fd, inode, 1024 << scan->sb.s_log_block_size, addDataBlock, &blocks);
+
+    fragment.inode = inode_id;
+    fragment.extents = (blocks.count > 0) ? 1 : 0;
+
+    for (int i = 1; i < blocks.count; i++) {
+        if (blocks.ids[i] != blocks.ids[i - 1] + 1) fragment.extents++;
+    }
+
+    // 0 when the file is contiguous, 1 when no two blocks are adjacent
+    fragment.score = (blocks.count > 1) ? (double) (fragment.extents - 1) / (blocks.count - 1) : 0.0;
+
+    fragmentation = &scan->workers[scan->worker];
+
+    fragmentation->files++;
+    fragmentation->extents += fragment.extents;
+    fragmentation->score += fragment.score;
+
+    if (fragment.extents > 1) {
+        fragmentation->fragmented_files++;
+        addFragment(fragmentation, fragment);
+    }
+
+    free(blocks.ids);
+}
+
+static void addFragment(EXTFragmentation *fragmentation, EXTFragment fragment) {
+
+    int i;
+
+    if (fragmentation->worst_count == MOST_FRAGMENTED) {
+
+        if (fragment.extents <= fragmentation->worst[MOST_FRAGMENTED - 1].extents) return;
+        fragmentation->worst_count--;
+    }
+
+    // Kept sorted by extent count, most fragmented first
+    for (i = fragmentation->worst_count; i > 0 && fragmentation->worst[i - 1].extents < fragment.extents; i--) {
+        fragmentation->worst[i] = fragmentation->worst[i - 1];
+    }
+
+    fragmentation->worst[i] = fragment;
+    fragmentation->worst_count++;
+}
+
+static int isFragmentCandidate(uint32_t inode_id, int is_dir, void *ctx) {
+    return is_dir || containsId((EXTIdList*) ctx, inode_id);
+}
+
+static int hasSuperblockCopy(Superblock sb, int group) {
+
+    int power;
+
+    // Without sparse_super every group keeps a copy
+    if (!(sb.s_feature_ro_compat & 0x0001) || group <= 1) return 1;
+
+    // Otherwise only groups that are powers of 3, 5 or 7 do
+    for (int base = 3; base <= 7; base += 2) {
+
+        for (power = base; power < group; power *= base);
+        if (power == group) return 1;
+    }
+
+    return 0;
+}
+
+static void markBlock(EXTCheckScan *scan, uint32_t block_id) {
+
+    if (block_id >= scan->sb.s_blocks_count) {
+        CHECK_report(&scan->logs[scan->worker], "Inode %u references block %u past the end of the filesystem", scan->inode, block_id);
+        return;
+    }
+
+    CHECK_addRef(&scan->block_refs[block_id]);
+}
+
+static void markMetadataBlocks(EXTCheckScan *scan, int group_count) {
+
+    uint32_t group_start, gdt_blocks, table_blocks;
+    int block_size;
+
+    block_size = 1024 << scan->sb.s_log_block_size;
+    gdt_blocks = (group_count * GROUP_DESC_SIZE + block_size - 1) / block_size;
+    table_blocks = (scan->sb.s_inodes_per_group * scan->sb.s_inode_size + block_size - 1) / block_size;
+
+    for (int i = 0; i < group_count; i++) {
+
+        group_start = scan->sb.s_first_data_block + i * scan->sb.s_blocks_per_group;
+
+        // Reserved GDT blocks are referenced from the resize inode, so only the superblock and GDT are marked here
+        if (hasSuperblockCopy(scan->sb, i)) {
+            for (uint32_t j = 0; j <= gdt_blocks; j++) markBlock(scan, group_start + j);
+        }
+
+        markBlock(scan, scan->gds[i].bg_block_bitmap);
+        markBlock(scan, scan->gds[i].bg_inode_bitmap);
+
+        for (uint32_t j = 0; j < table_blocks; j++) markBlock(scan, scan->gds[i].bg_inode_table + j);
+    }
+}
+
+static void markInodeBlock(uint32_t block_id, int level, void *ctx) {
+
+    (void) level;
+
+    markBlock((EXTCheckScan*) ctx, block_id);
+}
+
+static void checkDirectoryBlocks(EXTCheckScan *scan, Inode *inode) {
+
+    EXTIdList blocks;
+    EXTDirectoryEntry *dir_entry;
+    uint8_t *data;
+    int block_size, offset;
+
+    block_size = 1024 << scan->sb.s_log_block_size;
+
+    memset(&blocks, 0, sizeof(EXTIdList));
+    walkInodeBlocks(scan->fd, inode, block_size, addDataBlock, &blocks);
+
+    data = malloc(block_size);
+
+    for (int i = 0; i < blocks.count; i++) {
+
+        if (blocks.ids[i] >= scan->sb.s_blocks_count) continue;
+
+        IMAGE_pread(scan->fd, data, block_size, (off_t) blocks.ids[i] * block_size);
+
+        for (offset = 0; offset < block_size; offset += dir_entry->rec_len) {
+
+            dir_entry = (EXTDirectoryEntry*) (data + offset);
+
+            // Entries must be 4-byte aligned, fit their name and end exactly at the block boundary
+            if (offset + DIR_ENTRY_SIZE > block_size || dir_entry->rec_len < DIR_ENTRY_SIZE || dir_entry->rec_len % 4 != 0 || offset + dir_entry->rec_len > block_size || dir_entry->name_len + DIR_ENTRY_SIZE > dir_entry->rec_len) {
+                CHECK_report(&scan->logs[scan->worker], "Directory inode %u has an invalid entry at block %u offset %d (rec_len %u)", scan->inode, blocks.ids[i], offset, (offset + DIR_ENTRY_SIZE <= block_size) ? dir_entry->rec_len : 0);
+                break;
+            }
+
+            if (dir_entry->inode == 0) continue;
+
+            if (dir_entry->inode > scan->sb.s_inodes_count) {
+                CHECK_report(&scan->logs[scan->worker], "Directory inode %u has an entry for inode %u past the end of the inode tables", scan->inode, dir_entry->inode);
+                continue;
+            }
+
+            CHECK_addLink(&scan->link_refs[dir_entry->inode]);
+        }
+    }
+
+    free(data);
+    free(blocks.ids);
+}
+
+static void visitCheckInode(uint32_t inode_id, Inode *inode, void *ctx) {
+
+    EXTCheckScan *scan = ctx;
+
+    scan->inode = inode_id;
+    scan->link_counts[inode_id] = inode->i_links_count;
+
+    // Device files keep no block pointers at all
+    if ((inode->i_mode & 0xF000) == 0x2000 || (inode->i_mode & 0xF000) == 0x6000) return;
+
+    walkInodeBlocks(scan->fd, inode, 1024 << scan->sb.s_log_block_size, markInodeBlock, scan);
+
+    if ((inode->i_mode & 0xF000) == 0x4000) checkDirectoryBlocks(scan, inode);
+}
+
+static void checkInodes(int worker, int begin, int end, void *ctx) {
+
+    EXTCheckScan worker_scan;
+
+    worker_scan = *(EXTCheckScan*) ctx;
+    worker_scan.worker = worker;
+
+    // Reserved inodes are included, their blocks (resize inode, journal...) are in use too
+    scanInodeTables(worker_scan.fd, worker_scan.sb, worker_scan.gds, begin, end, 1, visitCheckInode, &worker_scan);
+}
+
+static void checkGroups(int worker, int begin, int end, void *ctx) {
+
+    EXTCheckScan *scan = ctx;
+    CheckLog *log;
+    uint8_t *bitmap;
+    uint32_t block_id, inode_id, first_inode, total_blocks, free_count;
+    int block_size, used, saturated;
+
+    log = &scan->logs[worker];
+    block_size = 1024 << scan->sb.s_log_block_size;
+    first_inode = (scan->sb.s_rev_level == 0) ? 11 : scan->sb.s_first_ino;
+
+    bitmap = malloc(block_size);
+
+    for (int group = begin; group < end; group++) {
+
+        total_blocks = scan->sb.s_blocks_count - scan->sb.s_first_data_block - group * scan->sb.s_blocks_per_group;
+        if (total_blocks > scan->sb.s_blocks_per_group) total_blocks = scan->sb.s_blocks_per_group;
+
+        IMAGE_pread(scan->fd, bitmap, block_size, (off_t) block_size * scan->gds[group].bg_block_bitmap);
+
+        // Descriptor counters are checked against the bitmaps, never used in place of them
+        free_count = total_blocks - countUsedBits(bitmap, total_blocks);
+
+        if (free_count != scan->gds[group].bg_free_blocks_count) {
+            CHECK_report(log, "Group %d descriptor counts %u free blocks but its bitmap has %u", group, scan->gds[group].bg_free_blocks_count, free_count);
+        }
+
+        for (uint32_t i = 0; i < total_blocks; i++) {
+
+            block_id = scan->sb.s_first_data_block + group * scan->sb.s_blocks_per_group + i;
+            used = (bitmap[i / 8] & (1 << (i % 8))) != 0;
+
+            if (used && scan->block_refs[block_id] == 0) {
+                CHECK_report(log, "Block %u is marked in use but nothing references it", block_id);
+            }
+            else if (!used && scan->block_refs[block_id] > 0) {
+                CHECK_report(log, "Block %u is referenced but marked free", block_id);
+            }
+
+            if (scan->block_refs[block_id] > 1) {
+                CHECK_report(log, "Block %u is referenced %s%u times", block_id, scan->block_refs[block_id] == CHECK_MAX_REFS ? "at least " : "", scan->block_refs[block_id]);
+            }
+        }
+
+        IMAGE_pread(scan->fd, bitmap, block_size, (off_t) block_size * scan->gds[group].bg_inode_bitmap);
+
+        free_count = scan->sb.s_inodes_per_group - countUsedBits(bitmap, scan->sb.s_inodes_per_group);
+
+        if (free_count != scan->gds[group].bg_free_inodes_count) {
+            CHECK_report(log, "Group %d descriptor counts %u free inodes but its bitmap has %u", group, scan->gds[group].bg_free_inodes_count, free_count);
+        }
+
+        for (uint32_t i = 0; i < scan->sb.s_inodes_per_group; i++) {
+
+            inode_id = group * scan->sb.s_inodes_per_group + i + 1;
+
+            // Reserved inodes other than the root directory are never linked from a directory
+            if (inode_id < first_inode && inode_id != 2) continue;
+
+            saturated = scan->link_refs[inode_id] == CHECK_MAX_LINKS;
+
+            // A saturated count only says "at least", so it can only be too many for a link count below it
+            if (scan->link_counts[inode_id] == 0 && scan->link_refs[inode_id] > 0) {
+                CHECK_report(log, "Inode %u is unused but %s%u directory entries reference it", inode_id, saturated ? "at least " : "", scan->link_refs[inode_id]);
+            }
+            else if (saturated ? scan->link_counts[inode_id] < CHECK_MAX_LINKS : scan->link_counts[inode_id] != scan->link_refs[inode_id]) {
+                CHECK_report(log, "Inode %u has link count %u but %s%u directory entries reference it", inode_id, scan->link_counts[inode_id], saturated ? "at least " : "", scan->link_refs[inode_id]);
+            }
+        }
+    }
+
+    free(bitmap);
+}
+
+static void collectListInode(uint32_t inode_id, Inode *inode, void *ctx) {
+
+    EXTListScan *scan = ctx;
+
+    addInode(&scan->inodes, inode_id, inode);
+    if ((inode->i_mode & 0xF000) == 0x4000) addInode(&scan->dirs, inode_id, inode);
+}
+
+static void mapBlocks(int fd, uint32_t block_id, int level, int block_size, uint64_t *logical_block, FileEntry *entry) {
+
+    uint32_t *entries;
+    uint64_t span = 1;
+
+    // Stop once the whole file is mapped
+    if (*logical_block * block_size >= entry->size) return;
+
+    for (int i = 0; i < level; i++) span *= block_size / 4;
+
+    // Unallocated pointers are holes covering everything below them
+    if (block_id == 0) {
+        *logical_block += span;
+        return;
+    }
+
+    if (level == 0) {
+        FILELIST_addExtent(entry, *logical_block * block_size, (uint64_t) block_id * block_size, block_size);
+        (*logical_block)++;
+        return;
+    }
+
+    entries = calloc(block_size, 1);
+    IMAGE_pread(fd, entries, block_size, (off_t) block_id * block_size);
+
+    for (int i = 0; i < block_size / 4; i++) {
+        mapBlocks(fd, entries[i], level - 1, block_size, logical_block, entry);
+    }
+
+    free(entries);
+}
+
+static void mapInodeExtents(int fd, Inode *inode, int block_size, FileEntry *entry) {
+
+    uint64_t logical_block = 0;
+
+    // Fast symlinks keep their target inside i_block instead of block pointers
+    if (inode->i_blocks == 0) return;
+
+    for (int i = 0; i < 12; i++) {
+        mapBlocks(fd, inode->i_block[i], 0, block_size, &logical_block, entry);
+    }
+    mapBlocks(fd, inode->i_block[12], 1, block_size, &logical_block, entry);
+    mapBlocks(fd, inode->i_block[13], 2, block_size, &logical_block, entry);
+    mapBlocks(fd, inode->i_block[14], 3, block_size, &logical_block, entry);
+}
+
+static void readInode(int fd, Superblock sb, GroupDescriptor *gds, uint32_t inode_id, Inode *inode) {
+
+    int block_size;
+
+    block_size = 1024 << sb.s_log_block_size;
+
+    IMAGE_pread(fd, inode, INODE_SIZE, (off_t) block_size * gds[(inode_id - 1) / sb.s_inodes_per_group].bg_inode_table + ((inode_id - 1) % sb.s_inodes_per_group) * sb.s_inode_size);
+}
+
+static void loadTreeLevel(int fd, Superblock sb, GroupDescriptor *gds, Tree *tree, int begin, int end) {
+
+    ImageRead *reads;
+    Inode *inodes;
+    EXTIdList *blocks;
+    uint8_t *data;
+    uint32_t inode_id;
+    uint64_t data_size, data_offset, block_count, list_size = 0, level_size, slice_size;
+    int block_size, dir_count = 0, read_count = 0, first, last, *dirs;
+
+    block_size = 1024 << sb.s_log_block_size;
+
+    for (int i = begin; i < end; i++) {
+        if (tree->entries[i].is_dir) dir_count++;
+    }
+
+    // Level buffers count against --memory like the tree itself, running out just leaves the tree incomplete
+    level_size = (uint64_t) dir_count * (sizeof(int) + sizeof(Inode) + sizeof(EXTIdList) + sizeof(ImageRead));
+
+    if (ARENA_reserve(level_size) < 0) {
+        tree->truncated = 1;
+        return;
+    }
+
+    dirs = malloc(sizeof(int) * dir_count);
+    dir_count = 0;
+
+    for (int i = begin; i < end; i++) {
+        if (tree->entries[i].is_dir) dirs[dir_count++] = i;
+    }
+
+    inodes = calloc(dir_count, sizeof(Inode));
+    blocks = calloc(dir_count, sizeof(EXTIdList));
+    reads = malloc(sizeof(ImageRead) * dir_count);
+
+    // First sweep: the inodes of every directory on this level
+    for (int i = 0; i < dir_count; i++) {
+
+        inode_id = tree->entries[dirs[i]].id;
+        if (inode_id == 0 || inode_id > sb.s_inodes_count) continue;
+
+        reads[read_count].offset = (off_t) block_size * gds[(inode_id - 1) / sb.s_inodes_per_group].bg_inode_table + ((inode_id - 1) % sb.s_inodes_per_group) * sb.s_inode_size;
+        reads[read_count].length = INODE_SIZE;
+        reads[read_count].buffer = &inodes[i];
+        read_count++;
+    }
+
+    IMAGE_readBatch(fd, reads, read_count);
+    free(reads);
+
+    // Block lists are sized from each directory's size up front, so they are charged before they are filled
+    for (int i = 0; i < dir_count; i++) {
+
+        if ((inodes[i].i_mode & 0xF000) != 0x4000) continue;
+
+        block_count = (getFileSize(&inodes[i]) + block_size - 1) / block_size;
+        if (block_count > sb.s_blocks_count) block_count = sb.s_blocks_count;
+
+        blocks[i].capacity = (int) block_count;
+        list_size += sizeof(uint32_t) * block_count;
+    }
+
+    if (ARENA_reserve(list_size) < 0) {
+        tree->truncated = 1;
+        list_size = 0;
+    }
+
+    for (int i = 0; i < dir_count && !tree->truncated; i++) {
+
+        if ((inodes[i].i_mode & 0xF000) != 0x4000) continue;
+
+        if (blocks[i].capacity > 0) blocks[i].ids = malloc(sizeof(uint32_t) * blocks[i].capacity);
+        walkInodeBlocks(fd, &inodes[i], block_size, addDataBlock, &blocks[i]);
+    }
+
+    // Second sweep: their directory blocks, a slice of the level at a time so wide levels don't need all of it in memory
+    for (first = 0; first < dir_count && !tree->truncated; first = last) {
+
+        data_size = 0;
+        read_count = 0;
+
+        for (last = first; last < dir_count; last++) {
+
+            if (last > first && data_size + (uint64_t) blocks[last].count * block_size > TREE_BATCH_SIZE) break;
+
+            data_size += (uint64_t) blocks[last].count * block_size;
+            read_count += blocks[last].count;
+        }
+
+        slice_size = data_size + sizeof(ImageRead) * read_count;
+
+        if (ARENA_reserve(slice_size) < 0) {
+            tree->truncated = 1;
+            break;
+        }
+
+        data = malloc(data_size);
+        reads = malloc(sizeof(ImageRead) * read_count);
+        read_count = 0;
+        data_offset = 0;
+
+        for (int i = first; i < last; i++) {
+            for (int j = 0; j < blocks[i].count; j++) {
+
+                reads[read_count].offset = (off_t) blocks[i].ids[j] * block_size;
+                reads[read_count].length = block_size;
+                reads[read_count].buffer = data + data_offset;
+                read_count++;
+
+                data_offset += block_size;
+            }
+        }
+
+        IMAGE_readBatch(fd, reads, read_count);
+
+        // Parsed in the order the directories were found, which keeps every listing in on-disk order
+        data_offset = 0;
+
+        for (int i = first; i < last; i++) {
+            addTreeEntries(tree, dirs[i], data + data_offset, blocks[i].count * block_size, block_size);
+            data_offset += (uint64_t) blocks[i].count * block_size;
+        }
+
+        free(reads);
+        free(data);
+        ARENA_release(slice_size);
+    }
+
+    for (int i = 0; i < dir_count; i++) {
+        free(blocks[i].ids);
+    }
+
+    free(blocks);
+    free(inodes);
+    free(dirs);
+
+    ARENA_release(list_size);
+    ARENA_release(level_size);
+}
+
+static void addTreeEntries(Tree *tree, int dir, uint8_t *data, int length, int block_size) {
+
+    EXTDirectoryEntry *dir_entry;
+    char name[256];
+
+    for (int block = 0; block < length; block += block_size) {
+
+        for (int offset = block; offset + DIR_ENTRY_SIZE <= block + block_size; offset += dir_entry->rec_len) {
+
+            dir_entry = (EXTDirectoryEntry*) (data + offset);
+
+            if (dir_entry->rec_len < DIR_ENTRY_SIZE) break;
+            if (dir_entry->inode == 0 || offset + DIR_ENTRY_SIZE + dir_entry->name_len > block + block_size) continue;
+
+            memcpy(name, data + offset + DIR_ENTRY_SIZE, dir_entry->name_len);
+            name[dir_entry->name_len] = '\0';
+
+            if (isInternalDirectory(name)) continue;
+
+            TREE_add(tree, dir, name, dir_entry->name_len, dir_entry->inode, dir_entry->file_type == 2);
+        }
+    }
+}
+
+static void readInodeBitmap(EXTWatch *watch, int group, uint8_t *inode_bitmap) {
+
+    int block_size;
+
+    block_size = 1024 << watch->sb.s_log_block_size;
+
+    IMAGE_pread(watch->fd, inode_bitmap, watch->sb.s_inodes_per_group / 8, (off_t) block_size * watch->gds[group].bg_inode_bitmap);
+}
+
+static void hashInodeTable(EXTWatch *watch, int group, EXTIdList *changed) {
+
+    uint8_t *table, *inode_bitmap;
+    uint64_t hash, *hashes;
+    uint32_t first, last;
+    int block_size;
+
+    block_size = 1024 << watch->sb.s_log_block_size;
+    table = malloc((size_t) watch->table_blocks * block_size);
+    inode_bitmap = watch->inode_bitmaps + group * (watch->sb.s_inodes_per_group / 8);
+    hashes = watch->table_hashes + (size_t) group * watch->table_blocks;
+
+    IMAGE_pread(watch->fd, table, (size_t) watch->table_blocks * block_size, (off_t) block_size * watch->gds[group].bg_inode_table);
+
+    // Any write to an inode lands in one table block, so only inodes sharing a changed block are looked at again
+    for (int i = 0; i < watch->table_blocks; i++) {
+
+        hash = HASH_compute(table + (size_t) i * block_size, block_size, i);
+        if (hash == hashes[i]) continue;
+
+        hashes[i] = hash;
+        if (changed == NULL) continue;
+
+        first = (uint32_t) i * block_size / watch->sb.s_inode_size;
+        last = (uint32_t) (i + 1) * block_size / watch->sb.s_inode_size;
+
+        for (uint32_t j = first; j < last && j < watch->sb.s_inodes_per_group; j++) {
+            if (inode_bitmap[j / 8] & (1 << (j % 8))) addId(changed, group * watch->sb.s_inodes_per_group + j + 1);
+        }
+    }
+
+    free(table);
+}
+
+static void addWatchBlock(EXTWatch *watch, uint32_t block, uint32_t dir_id, uint64_t hash) {
+
+    if (watch->block_count == watch->block_capacity) {
+        watch->block_capacity = (watch->block_capacity == 0) ? 64 : watch->block_capacity * 2;
+        watch->blocks = realloc(watch->blocks, sizeof(EXTWatchBlock) * watch->block_capacity);
+    }
+
+    watch->blocks[watch->block_count].block = block;
+    watch->blocks[watch->block_count].dir_id = dir_id;
+    watch->blocks[watch->block_count].hash = hash;
+    watch->block_count++;
+}
+
+static void hashDirectoryBlocks(EXTWatch *watch, EXTWatchScan *scan) {
+
+    ImageRead *reads;
+    EXTWatchBlock *block;
+    uint8_t *data;
+    int *records;
+    int block_size, kept = 0, read_count = 0;
+
+    block_size = 1024 << watch->sb.s_log_block_size;
+
+    reads = malloc(sizeof(ImageRead) * (watch->block_count + 1));
+    records = malloc(sizeof(int) * (watch->block_count + 1));
+
+    // Blocks of directories no longer in the tree are dropped, the rest are all read again
+    for (int i = 0; i < watch->block_count; i++) {
+
+        if (WATCH_findDirectory(&watch->tree, watch->blocks[i].dir_id) == NULL) continue;
+
+        watch->blocks[kept] = watch->blocks[i];
+        records[read_count++] = kept++;
+    }
+
+    watch->block_count = kept;
+    data = malloc((size_t) read_count * block_size + 1);
+
+    for (int i = 0; i < read_count; i++) {
+        reads[i].offset = (off_t) watch->blocks[records[i]].block * block_size;
+        reads[i].length = block_size;
+        reads[i].buffer = data + (size_t) i * block_size;
+    }
+
+    IMAGE_readBatch(watch->fd, reads, read_count);
+
+    // Renames and entries added in place only show in the directory blocks themselves
+    for (int i = 0; i < read_count; i++) {
+
+        block = &watch->blocks[records[i]];
+
+        if (HASH_compute(data + (size_t) i * block_size, block_size, block->block) != block->hash) addId(&scan->dirs, block->dir_id);
+    }
+
+    free(data);
+    free(records);
+    free(reads);
+}
+
+static int listWatchDirectory(uint64_t id, WatchEntry **entries, uint64_t *fingerprint, void *ctx) {
+
+    EXTWatch *watch = ctx;
+    EXTIdList blocks;
+    EXTDirectoryEntry *dir_entry;
+    WatchEntry *entry;
+    Inode inode;
+    uint8_t *data;
+    int block_size, offset, count = 0, capacity = 0;
+
+    block_size = 1024 << watch->sb.s_log_block_size;
+
+    readInode(watch->fd, watch->sb, watch->gds, id, &inode);
+    if ((inode.i_mode & 0xF000) != 0x4000) return -1;
+
+    *entries = NULL;
+    *fingerprint = 0;
+
+    memset(&blocks, 0, sizeof(EXTIdList));
+    walkInodeBlocks(watch->fd, &inode, block_size, addDataBlock, &blocks);
+
+    data = malloc(block_size);
+
+    // Blocks are recorded with their hashes, so polls can tell which directory a changed block belongs to
+    for (int i = 0; i < watch->block_count; i++) {
+        if (watch->blocks[i].dir_id == id) watch->blocks[i--] = watch->blocks[--watch->block_count];
+    }
+
+    for (int i = 0; i < blocks.count; i++) {
+
+        IMAGE_pread(watch->fd, data, block_size, (off_t) blocks.ids[i] * block_size);
+        *fingerprint = HASH_compute(data, block_size, *fingerprint);
+        addWatchBlock(watch, blocks.ids[i], id, HASH_compute(data, block_size, blocks.ids[i]));
+
+        for (offset = 0; offset + DIR_ENTRY_SIZE <= block_size; offset += dir_entry->rec_len) {
+
+            dir_entry = (EXTDirectoryEntry*) (data + offset);
+
+            if (dir_entry->rec_len < DIR_ENTRY_SIZE) break;
+            if (dir_entry->inode == 0 || dir_entry->inode > watch->sb.s_inodes_count) continue;
+            if (offset + DIR_ENTRY_SIZE + dir_entry->name_len > block_size) continue;
+
+            if (dir_entry->name_len == 1 && data[offset + DIR_ENTRY_SIZE] == '.') continue;
+            if (dir_entry->name_len == 2 && data[offset + DIR_ENTRY_SIZE] == '.' && data[offset + DIR_ENTRY_SIZE + 1] == '.') continue;
+
+            if (count == capacity) {
+                capacity = (capacity == 0) ? 16 : capacity * 2;
+                *entries = realloc(*entries, sizeof(WatchEntry) * capacity);
+            }
+
+            entry = &(*entries)[count++];
+
+            entry->name = malloc(dir_entry->name_len + 1);
+            memcpy(entry->name, data + offset + DIR_ENTRY_SIZE, dir_entry->name_len);
+            entry->name[dir_entry->name_len] = '\0';
+
+            // Sizes and times live in the inodes, not in the directory entries
+            readInode(watch->fd, watch->sb, watch->gds, dir_entry->inode, &inode);
+
+            entry->id = dir_entry->inode;
+            entry->is_dir = (inode.i_mode & 0xF000) == 0x4000;
+            entry->size = entry->is_dir ? 0 : getFileSize(&inode);
+            entry->mtime = inode.i_mtime;
+        }
+    }
+
+    free(data);
+    free(blocks.ids);
+
+    return count;
+}
+
+static void loadWatchGroups(EXTWatch *watch) {
+
+    free(watch->inode_bitmaps);
+    free(watch->table_hashes);
+
+    watch->inode_bitmaps = calloc(watch->group_count, watch->sb.s_inodes_per_group / 8);
+    watch->table_hashes = calloc((size_t) watch->group_count * watch->table_blocks, sizeof(uint64_t));
+
+    for (int group = 0; group < watch->group_count; group++) {
+        readInodeBitmap(watch, group, watch->inode_bitmaps + group * (watch->sb.s_inodes_per_group / 8));
+        hashInodeTable(watch, group, NULL);
+    }
+}
+
+static void pollChanges(EXTWatch *watch) {
+
+    EXTWatchScan scan;
+    Superblock sb;
+    GroupDescriptor *gds;
+    uint8_t *inode_bitmap, *old_bitmap;
+    int group_count, bitmap_size;
+
+    sb = getSuperblock(watch->fd);
+    gds = getGroupDescriptors(watch->fd, sb, &group_count);
+
+    // Unless something was written, a poll costs the superblock and the descriptor table.
+    // Writes within the second s_wtime was last set in can't be told apart, so that second is always looked at
+    if (group_count == watch->group_count && sb.s_wtime == watch->sb.s_wtime && sb.s_wtime < time(NULL) - 1 && memcmp(gds, watch->gds, group_count * GROUP_DESC_SIZE) == 0) {
+        free(gds);
+        return;
+    }
+
+    memset(&scan, 0, sizeof(EXTWatchScan));
+
+    // A resize leaves nothing to compare the groups against, so they are loaded again and every directory listed again
+    if (group_count != watch->group_count) {
+
+        free(watch->gds);
+        watch->gds = gds;
+        watch->sb = sb;
+        watch->group_count = group_count;
+
+        loadWatchGroups(watch);
+
+        for (int i = 0; i < watch->tree.count; i++) addId(&scan.dirs, watch->tree.directories[i].id);
+
+        refreshWatchDirectories(watch, &scan.dirs);
+        free(scan.dirs.ids);
+
+        return;
+    }
+
+    scan.watch = watch;
+
+    free(watch->gds);
+    watch->gds = gds;
+    watch->sb = sb;
+
+    bitmap_size = sb.s_inodes_per_group / 8;
+    inode_bitmap = malloc(bitmap_size);
+
+    for (int group = 0; group < group_count; group++) {
+
+        old_bitmap = watch->inode_bitmaps + group * bitmap_size;
+
+        readInodeBitmap(watch, group, inode_bitmap);
+
+        // Freed inodes are gone from the inode table, only the old bitmap still knows them
+        for (int i = 0; i < bitmap_size * 8; i++) {
+            if ((old_bitmap[i / 8] & (1 << (i % 8))) && !(inode_bitmap[i / 8] & (1 << (i % 8)))) addId(&scan.freed, group * sb.s_inodes_per_group + i + 1);
+        }
+
+        memcpy(old_bitmap, inode_bitmap, bitmap_size);
+
+        // Same size rewrites and appends inside the last block leave counts and bitmaps alone, so every inode table is hashed
+        hashInodeTable(watch, group, &scan.changed);
+    }
+
+    free(inode_bitmap);
+
+    // Changed directories are refreshed themselves, changed and freed inodes through the directories naming them
+    for (int i = 0; i < scan.changed.count; i++) {
+        if (WATCH_findDirectory(&watch->tree, scan.changed.ids[i]) != NULL) addId(&scan.dirs, scan.changed.ids[i]);
+    }
+
+    findWatchParents(watch, &scan.freed, &scan.dirs);
+    findWatchParents(watch, &scan.changed, &scan.dirs);
+
+    // Renames inside an existing block only show in the directory blocks themselves
+    hashDirectoryBlocks(watch, &scan);
+    refreshWatchDirectories(watch, &scan.dirs);
+
+    free(scan.changed.ids);
+    free(scan.freed.ids);
+    free(scan.dirs.ids);
+}
+
+static void findWatchParents(EXTWatch *watch, EXTIdList *inodes, EXTIdList *dirs) {
+
+    uint64_t *ids, *parents;
+    uint8_t *found;
+    int parent_count;
+
+    qsort(inodes->ids, inodes->count, sizeof(uint32_t), compareIds);
+
+    ids = malloc(sizeof(uint64_t) * (inodes->count + 1));
+    found = malloc(inodes->count + 1);
+
+    for (int i = 0; i < inodes->count; i++) ids[i] = inodes->ids[i];
+
+    parent_count = WATCH_findParents(&watch->tree, ids, inodes->count, found, &parents);
+
+    for (int i = 0; i < parent_count; i++) addId(dirs, parents[i]);
+
+    free(ids);
+    free(found);
+    free(parents);
+}
+
+static void refreshWatchDirectories(EXTWatch *watch, EXTIdList *dirs) {
+
+    qsort(dirs->ids, dirs->count, sizeof(uint32_t), compareIds);
+
+    for (int i = 0; i < dirs->count; i++) {
+        if (i == 0 || dirs->ids[i] != dirs->ids[i - 1]) WATCH_refresh(&watch->tree, dirs->ids[i]);
+    }
+
+    dirs->count = 0;
+}
+
+static int probe(uint8_t *buffer, size_t length) {
+
+    Superblock *sb;
+
+    if (length < SUPERBLOCK_OFFSET + SUPERBLOCK_SIZE) return 0;
+
+    sb = (Superblock*) (buffer + SUPERBLOCK_OFFSET);
+
+    return sb->s_magic == 0xEF53;
+}
+
+static void* mountFilesystem(int fd) {
+
+    EXTMount *mount;
+    GroupDescriptor *gds;
+
+    mount = calloc(1, sizeof(EXTMount));
+
+    ARENA_init(&mount->arena);
+    ARENA_init(&mount->dir_cache);
+    ARENA_init(&mount->file_cache);
+
+    mount->fd = fd;
+    mount->sb = getSuperblock(fd);
+    mount->block_size = 1024 << mount->sb.s_log_block_size;
+
+    // Everything a mount keeps lives in its arenas, so unmounting is a handful of frees whatever was read
+    gds = getGroupDescriptors(fd, mount->sb, &mount->group_count);
+    mount->gds = ARENA_copy(&mount->arena, gds, mount->group_count * GROUP_DESC_SIZE);
+    mount->dir_data = ARENA_alloc(&mount->arena, mount->block_size);
+    free(gds);
+
+    if (mount->gds == NULL || mount->dir_data == NULL) {
+        unmountFilesystem(mount);
+        return NULL;
+    }
+
+    return mount;
+}
+
+static int statEntry(void *mount, uint64_t id, BackendStat *stat) {
+
+    EXTMount *ext = mount;
+    Inode inode;
+
+    if (id == 0 || id > ext->sb.s_inodes_count) return -1;
+
+    readInode(ext->fd, ext->sb, ext->gds, id, &inode);
+    if (inode.i_mode == 0) return -1;
+
+    stat->is_dir = (inode.i_mode & 0xF000) == 0x4000;
+    stat->size = getFileSize(&inode);
+    stat->mtime = inode.i_mtime;
+
+    return 0;
+}
+
+static int readDirectory(void *mount, uint64_t dir_id, uint64_t *cookie, BackendEntry *entry) {
+
+    EXTMount *ext = mount;
+    EXTDirectoryEntry *dir_entry;
+    EXTIdList blocks;
+    Inode inode;
+    uint64_t start;
+    int block, offset, run;
+
+    // Block list of the last directory read is kept, so listing one costs a single walk of its block map
+    if (ext->dir_id != dir_id) {
+
+        if (dir_id == 0 || dir_id > ext->sb.s_inodes_count) return -1;
+
+        readInode(ext->fd, ext->sb, ext->gds, dir_id, &inode);
+        if ((inode.i_mode & 0xF000) != 0x4000) return -1;
+
+        memset(&blocks, 0, sizeof(EXTIdList));
+        walkInodeBlocks(ext->fd, &inode, ext->block_size, addDataBlock, &blocks);
+
+        ext->dir_id = 0;
+        ext->dir_blocks.count = blocks.count;
+        ext->dir_blocks.capacity = blocks.count;
+        ext->dir_blocks.ids = allocateCache(ext, &ext->dir_cache, sizeof(uint32_t) * blocks.count);
+
+        if (ext->dir_blocks.ids != NULL) memcpy(ext->dir_blocks.ids, blocks.ids, sizeof(uint32_t) * blocks.count);
+        free(blocks.ids);
+
+        if (ext->dir_blocks.ids == NULL) return -1;
+
+        // Large directories are read block by block, so the kernel is asked for each contiguous run up front
+        for (block = 0; block < ext->dir_blocks.count && ext->dir_blocks.count > 1; block += run) {
+            for (run = 1; block + run < ext->dir_blocks.count && ext->dir_blocks.ids[block + run] == ext->dir_blocks.ids[block] + run; run++);
+            IMAGE_willNeed(ext->fd, (off_t) ext->dir_blocks.ids[block] * ext->block_size, (off_t) run * ext->block_size);
+        }
+
+        ext->dir_id = dir_id;
+        ext->dir_block = -1;
+        ext->dir_start = 0;
+        ext->dir_end = 0;
+    }
+
+    // Cookies are byte positions in the directory, so a listing can resume anywhere
+    if (*cookie > (uint64_t) ext->dir_blocks.count * ext->block_size) return -1;
+
+    start = *cookie;
+
+    while (*cookie < (uint64_t) ext->dir_blocks.count * ext->block_size) {
+
+        block = *cookie / ext->block_size;
+
+        if (ext->dir_block != block) {
+            IMAGE_pread(ext->fd, ext->dir_data, ext->block_size, (off_t) ext->dir_blocks.ids[block] * ext->block_size);
+            ext->dir_block = block;
+        }
+
+        offset = *cookie % ext->block_size;
+
+        // Cookies this mount didn't just hand out, like the ones in a --cursor, have to land on an entry
+        if (*cookie == start && start != ext->dir_start && start != ext->dir_end && !isEntryOffset(ext->dir_data, offset, ext->block_size)) return -1;
+
+        dir_entry = (EXTDirectoryEntry*) (ext->dir_data + offset);
+
+        if (offset + DIR_ENTRY_SIZE > ext->block_size || dir_entry->rec_len < DIR_ENTRY_SIZE) {
+            *cookie = (uint64_t) (block + 1) * ext->block_size;
+            continue;
+        }
+
+        *cookie += dir_entry->rec_len;
+
+        if (dir_entry->inode == 0 || offset + DIR_ENTRY_SIZE + dir_entry->name_len > ext->block_size) continue;
+        if (dir_entry->name_len == 1 && ext->dir_data[offset + DIR_ENTRY_SIZE] == '.') continue;
+        if (dir_entry->name_len == 2 && ext->dir_data[offset + DIR_ENTRY_SIZE] == '.' && ext->dir_data[offset + DIR_ENTRY_SIZE + 1] == '.') continue;
+
+        entry->id = dir_entry->inode;
+        entry->is_dir = dir_entry->file_type == 2;
+        memcpy(entry->name, ext->dir_data + offset + DIR_ENTRY_SIZE, dir_entry->name_len);
+        entry->name[dir_entry->name_len] = '\0';
+        entry->long_name[0] = '\0';
+
+        // Sizes and times live in the inode, which readdir doesn't read
+        entry->has_stat = 0;
+
+        ext->dir_start = start;
+        ext->dir_end = *cookie;
+
+        return 1;
+    }
+
+    return 0;
+}
+
+static int isEntryOffset(uint8_t *data, int offset, int block_size) {
+
+    EXTDirectoryEntry *dir_entry;
+    int position = 0;
+
+    // Entries chain through rec_len from the start of their block
+    while (position < offset && position + DIR_ENTRY_SIZE <= block_size) {
+
+        dir_entry = (EXTDirectoryEntry*) (data + position);
+        if (dir_entry->rec_len < DIR_ENTRY_SIZE) return 0;
+
+        position += dir_entry->rec_len;
+    }
+
+    return position == offset;
+}
+
+static int64_t readFile(void *mount, uint64_t id, uint64_t offset, void *buffer, uint64_t length) {
+
+    EXTMount *ext = mount;
+    FileEntry file;
+    Inode inode;
+
+    // Extents of the last file read are kept, so sequential reads map its blocks only once
+    if (ext->file_id != id) {
+
+        if (id == 0 || id > ext->sb.s_inodes_count) return -1;
+
+        readInode(ext->fd, ext->sb, ext->gds, id, &inode);
+        if ((inode.i_mode & 0xF000) != 0x8000) return -1;
+
+        memset(&file, 0, sizeof(FileEntry));
+
+        file.size = getFileSize(&inode);
+        mapInodeExtents(ext->fd, &inode, ext->block_size, &file);
+
+        ext->file_id = 0;
+        ext->file = file;
+        ext->file.extents = allocateCache(ext, &ext->file_cache, sizeof(FileExtent) * file.extent_count);
+
+        if (ext->file.extents != NULL) memcpy(ext->file.extents, file.extents, sizeof(FileExtent) * file.extent_count);
+        free(file.extents);
+
+        if (ext->file.extents == NULL) return -1;
+
+        ext->file_id = id;
+    }
+
+    return FILELIST_read(ext->fd, &ext->file, offset, buffer, length);
+}
+
+static void unmountFilesystem(void *mount) {
+
+    EXTMount *ext = mount;
+
+    ARENA_free(&ext->arena);
+    ARENA_free(&ext->dir_cache);
+    ARENA_free(&ext->file_cache);
+    free(ext);
+}
+
+static void* allocateCache(EXTMount *mount, Arena *cache, size_t size) {
+
+    void *data;
+
+    ARENA_reset(cache);
+
+    // At the memory limit the other cache is dropped to make room, it can always be read again
+    if ((data = ARENA_alloc(cache, size)) == NULL) {
+
+        if (cache == &mount->dir_cache) {
+            ARENA_free(&mount->file_cache);
+            mount->file_id = 0;
+        }
+        else {
+            ARENA_free(&mount->dir_cache);
+            mount->dir_id = 0;
+        }
+
+        data = ARENA_alloc(cache, size);
+    }
+
+    return data;
+}
+
+Backend EXT2_backend = {
+    "EXT2", 2, 0,
+    probe, mountFilesystem, statEntry, readDirectory, readFile, unmountFilesystem,
+    EXT2_showInfo, EXT2_getInfo, EXT2_showDeepInfo, EXT2_showTree, EXT2_showFile, EXT2_find,
+    EXT2_showUsage, EXT2_checkConsistency, EXT2_listFiles, EXT2_watch
+};
\ No newline at end of file
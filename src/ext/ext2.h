@@ -9,19 +9,29 @@
 #include <stdlib.h>
 #include <stdint.h>
 
+#include "../io/image.h"
+#include "../find/find.h"
+#include "../du/du.h"
+#include "../parallel/parallel.h"
+#include "../check/check.h"
+#include "../list/filelist.h"
+#include "../fleet/fleet.h"
+#include "../hash/hash.h"
+#include "../watch/watch.h"
+#include "../backend/backend.h"
+#include "../tree/tree.h"
+#include "../mem/arena.h"
+
 #define SUPERBLOCK_OFFSET 1024
 #define SUPERBLOCK_SIZE 204
 #define GROUP_DESC_SIZE 32
 #define INODE_SIZE 128
 #define DIR_ENTRY_SIZE 8
+#define FREE_RUN_BUCKETS 32
+#define MOST_FRAGMENTED 5
 
 #pragma pack(1)
 
-typedef struct {
-    int count;
-    int* is_last;
-} EXTNest;
-
 typedef struct {
     uint32_t s_inodes_count;
     uint32_t s_blocks_count;
@@ -101,9 +111,157 @@ typedef struct {
 
 #pragma pack()
 
-int EXT2_check(int fd);
+typedef struct {
+    int count;
+    int capacity;
+    uint32_t* ids;
+} EXTIdList;
+
+typedef struct {
+    int count;
+    int capacity;
+    uint32_t* ids;
+    Inode* inodes;
+} EXTInodeList;
+
+typedef struct {
+    uint32_t inode;
+    uint32_t parent;
+    char* name;
+} EXTName;
+
+typedef struct {
+    int count;
+    int capacity;
+    EXTName* names;
+} EXTNameMap;
+
+typedef struct {
+    FindQuery* query;
+    EXTIdList matches;
+    EXTInodeList dirs;
+} EXTFindScan;
+
+typedef struct {
+    uint32_t inode;
+    uint64_t size;
+    uint64_t allocated;
+} EXTUsage;
+
+typedef struct {
+    int count;
+    int capacity;
+    EXTUsage* usage;
+    EXTInodeList dirs;
+} EXTUsageScan;
+
+typedef struct {
+    uint32_t total_blocks;
+    uint32_t free_blocks;
+    uint32_t free_inodes;
+    uint32_t leading_free;
+    uint32_t trailing_free;
+    uint64_t free_runs[FREE_RUN_BUCKETS];
+} EXTGroupBitmaps;
+
+typedef struct {
+    uint32_t inode;
+    uint32_t extents;
+    double score;
+} EXTFragment;
+
+typedef struct {
+    uint64_t files;
+    uint64_t fragmented_files;
+    uint64_t extents;
+    double score;
+    int worst_count;
+    EXTFragment worst[MOST_FRAGMENTED];
+} EXTFragmentation;
+
+typedef struct {
+    int fd;
+    Superblock sb;
+    GroupDescriptor* gds;
+    EXTGroupBitmaps* groups;
+    EXTFragmentation* workers;
+    int worker;
+} EXTDeepScan;
+
+typedef struct {
+    int fd;
+    Superblock sb;
+    GroupDescriptor* gds;
+    uint8_t* block_refs;
+    uint16_t* link_refs;
+    uint16_t* link_counts;
+    CheckLog* logs;
+    int worker;
+    uint32_t inode;
+} EXTCheckScan;
+
+typedef struct {
+    EXTInodeList inodes;
+    EXTInodeList dirs;
+} EXTListScan;
+
+typedef struct {
+    uint32_t block;
+    uint32_t dir_id;
+    uint64_t hash;
+} EXTWatchBlock;
+
+typedef struct {
+    int fd;
+    Superblock sb;
+    GroupDescriptor* gds;
+    int group_count;
+    uint8_t* inode_bitmaps;
+    int table_blocks;
+    uint64_t* table_hashes;
+    int block_count;
+    int block_capacity;
+    EXTWatchBlock* blocks;
+    WatchTree tree;
+} EXTWatch;
+
+typedef struct {
+    EXTWatch* watch;
+    EXTIdList changed;
+    EXTIdList freed;
+    EXTIdList dirs;
+} EXTWatchScan;
+
+typedef struct {
+    int fd;
+    Superblock sb;
+    GroupDescriptor* gds;
+    int group_count;
+    int block_size;
+    uint64_t dir_id;
+    EXTIdList dir_blocks;
+    int dir_block;
+    uint64_t dir_start;
+    uint64_t dir_end;
+    uint8_t* dir_data;
+    uint64_t file_id;
+    FileEntry file;
+    Arena arena;
+    Arena dir_cache;
+    Arena file_cache;
+} EXTMount;
+
+extern Backend EXT2_backend;
+
 void EXT2_showInfo(int fd);
+void EXT2_getInfo(int fd, FleetInfo *info);
+void EXT2_showDeepInfo(int fd);
 void EXT2_showTree(int fd);
 int EXT2_showFile(int fd, char *file_name);
+void EXT2_find(int fd, FindQuery *query);
+void EXT2_showUsage(int fd, int top);
+int EXT2_checkConsistency(int fd);
+void EXT2_listFiles(int fd, FileList *list);
+void EXT2_watch(int fd, int interval);
 
 #endif
\ No newline at end of file
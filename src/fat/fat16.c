@@ -3,27 +3,49 @@
 BootSector getBootSector(int fd);
 void getNextCluster(int fd, int *current_cluster, BootSector bs);
 static int isInternalFile(char* name, int attr);
-static int isLastEntry(int fd, int *next_entry, int *cluster_id, int *neighbour_cluster, BootSector bs);
-void cleanName(char (*dest)[12], uint8_t* name);
-static char* getNestFormat(FATNest nest);
-FATNest* clone(FATNest *nest, int is_last);
-FATDirectoryEntry* traverseDirectory(int fd, int cluster_id, char* file_name, FATNest *nest, BootSector bs);
+void cleanName(char (*dest)[13], uint8_t* name);
+FATDirectoryEntry* traverseDirectory(int fd, int cluster_id, char* file_name, BootSector bs);
 static void showFile(int fd, FATDirectoryEntry *file_entry, BootSector bs);
-
-int FAT16_check(int fd) {
-
-    BootSector bs;
-    int root_dir_sectors, data_sectors, cluster_count; 
-
-    bs = getBootSector(fd);
-
-    root_dir_sectors = ((bs.BPB_RootEntCnt * DIRECTORY_ENTRY_SIZE) + (bs.BPB_BytsPerSec - 1)) / bs.BPB_BytsPerSec;
-
-    data_sectors = bs.BPB_TotSec16 - (bs.BPB_RsvdSecCnt + (bs.BPB_NumFATs * bs.BPB_FATSz16) + root_dir_sectors);
-    cluster_count = data_sectors / bs.BPB_SecPerClus;
-
-    return (cluster_count >= 4085 && cluster_count < 65525);
-}
+static int getClusterSize(BootSector bs);
+static int getRootOffset(BootSector bs);
+static int getDataOffset(BootSector bs);
+static uint32_t getTotalSectors(BootSector bs);
+static int getClusterCount(BootSector bs);
+static int getFATEntryCount(BootSector bs);
+static uint16_t* getFAT(int fd, BootSector bs);
+static int isEndOfChain(uint16_t cluster_id, BootSector bs);
+static FATDirectoryEntry* getDirectory(int fd, int cluster_id, uint16_t *fat, BootSector bs, int *total_entries);
+static void walkDirectory(int fd, int cluster_id, char *path, uint16_t *fat, BootSector bs, void (*visit)(char *path, char *name, FATDirectoryEntry *entry, void *ctx), void *ctx);
+static time_t getModificationTime(FATDirectoryEntry *entry);
+static int getChainLength(uint16_t *fat, int cluster_id, BootSector bs);
+static int isAncestor(char *dir_path, char *path);
+static void pushUsageDir(FATUsageScan *scan, char *path, uint64_t size, uint64_t allocated);
+static void popUsageDir(FATUsageScan *scan);
+static void visitUsageEntry(char *path, char *name, FATDirectoryEntry *entry, void *ctx);
+static FATEntryCounts countEntries(uint16_t *fat, int total_entries);
+static void visitAnalysisEntry(char *path, char *name, FATDirectoryEntry *entry, void *ctx);
+static void countChainRefs(int worker, int begin, int end, void *ctx);
+static void visitListEntry(char *path, char *name, FATDirectoryEntry *entry, void *ctx);
+static void visitCheckEntry(char *path, char *name, FATDirectoryEntry *entry, void *ctx);
+static void checkCrossLinks(int worker, int begin, int end, void *ctx);
+static void hashSectors(FATWatch *watch, uint16_t *fat, uint8_t *changed_sectors);
+static void addWatchCluster(FATWatch *watch, uint64_t dir_id, uint16_t cluster, uint64_t hash);
+static int listWatchDirectory(uint64_t id, WatchEntry **entries, uint64_t *fingerprint, void *ctx);
+static void pollChanges(FATWatch *watch);
+static int compareIds(const void *a, const void *b);
+static void mapChain(BootSector bs, uint16_t *fat, FATDirectoryEntry *entry, FileEntry *file_entry);
+static void loadTreeLevel(int fd, BootSector bs, uint16_t *fat, Tree *tree, int begin, int end);
+static void addTreeEntries(Tree *tree, int dir, FATDirectoryEntry *entries, int total_entries);
+static int readEntry(FATMount *mount, uint64_t id, FATDirectoryEntry *entry);
+static uint64_t getEntryOffset(FATMount *mount, int index);
+static void getLongName(FATDirectoryEntry *entries, int index, char *long_name);
+static int probe(uint8_t *buffer, size_t length);
+static void* mountFilesystem(int fd);
+static int statEntry(void *mount, uint64_t id, BackendStat *stat);
+static int readDirectory(void *mount, uint64_t dir_id, uint64_t *cookie, BackendEntry *entry);
+static int64_t readFile(void *mount, uint64_t id, uint64_t offset, void *buffer, uint64_t length);
+static void unmountFilesystem(void *mount);
+static void* allocateCache(FATMount *mount, Arena *cache, size_t size);
 
 void FAT16_showInfo(int fd) {
 
@@ -47,18 +69,118 @@ void FAT16_showInfo(int fd) {
     printf("Label: %s\n\n", label);
 }
 
+void FAT16_getInfo(int fd, FleetInfo *info) {
+
+    BootSector bs;
+    uint16_t *fat;
+    int length, cluster_count, entry_limit;
+
+    bs = getBootSector(fd);
+    fat = getFAT(fd, bs);
+
+    strcpy(info->filesystem, "FAT16");
+    memcpy(info->label, bs.BS_VolLab, 11);
+
+    // Labels are padded with spaces up to 11 characters
+    for (length = 11; length > 0 && info->label[length - 1] == ' '; length--);
+    info->label[length] = '\0';
+
+    info->block_size = getClusterSize(bs);
+    cluster_count = getClusterCount(bs);
+
+    // Same bound as the deep analysis, a short FAT has no entries for the clusters past its end
+    entry_limit = getFATEntryCount(bs);
+    if (entry_limit > cluster_count + 2) entry_limit = cluster_count + 2;
+
+    info->total_blocks = cluster_count;
+
+    info->free_blocks = countEntries(fat + 2, entry_limit - 2).free_clusters;
+
+    free(fat);
+}
+
+void FAT16_showDeepInfo(int fd) {
+
+    FATAnalysis analysis;
+    FATEntryCounts counts;
+    uint32_t lost_clusters = 0, lost_chains = 0;
+    uint8_t *lost_targets;
+    int cluster_count, entry_limit;
+
+    memset(&analysis, 0, sizeof(FATAnalysis));
+
+    analysis.bs = getBootSector(fd);
+    analysis.fat = getFAT(fd, analysis.bs);
+
+    cluster_count = getClusterCount(analysis.bs);
+
+    // Only entries 2 to cluster_count + 1 map to data clusters, and a damaged boot sector can make the FAT shorter than that
+    entry_limit = getFATEntryCount(analysis.bs);
+    if (entry_limit > cluster_count + 2) entry_limit = cluster_count + 2;
+
+    counts = countEntries(analysis.fat + 2, entry_limit - 2);
+
+    // One directory pass marks every cluster reachable from an entry
+    analysis.reachable = calloc(cluster_count + 2, 1);
+    walkDirectory(fd, 0, "", analysis.fat, analysis.bs, visitAnalysisEntry, &analysis);
+
+    // Allocated clusters nothing points at are lost, and those no other lost cluster points at start a lost chain
+    lost_targets = calloc(cluster_count + 2, 1);
+
+    for (int i = 2; i < entry_limit; i++) {
+
+        if (analysis.reachable[i] || analysis.fat[i] == 0x0000 || analysis.fat[i] == 0xFFF7) continue;
+
+        lost_clusters++;
+        if (!isEndOfChain(analysis.fat[i], analysis.bs)) lost_targets[analysis.fat[i]] = 1;
+    }
+
+    for (int i = 2; i < entry_limit; i++) {
+
+        if (analysis.reachable[i] || analysis.fat[i] == 0x0000 || analysis.fat[i] == 0xFFF7) continue;
+        if (!lost_targets[i]) lost_chains++;
+    }
+
+    printf("FAT ANALYSIS\n");
+    printf("  Clusters: %d\n", cluster_count);
+    printf("  Free clusters: %u\n", counts.free_clusters);
+    printf("  Bad clusters: %u\n", counts.bad_clusters);
+    printf("  End of chain markers: %u\n", counts.end_of_chain);
+    printf("  Chains: %u\n", analysis.chains);
+    printf("  Average chain length: %.2f\n", analysis.chains ? (double) analysis.chained_clusters / analysis.chains : 0.0);
+    printf("  Longest chain: %u\n", analysis.longest_chain);
+    printf("  Fragmented chains: %u\n", analysis.fragmented_chains);
+    printf("  Lost clusters: %u\n", lost_clusters);
+    printf("  Lost chains: %u\n\n", lost_chains);
+
+    free(lost_targets);
+    free(analysis.reachable);
+    free(analysis.fat);
+}
+
 void FAT16_showTree(int fd) {
 
     BootSector bs;
-    FATNest *nest;
+    uint16_t *fat;
+    Tree tree;
+    int level_start, level_end;
 
     bs = getBootSector(fd);
+    fat = getFAT(fd, bs);
+
+    // If 0 provided, read root directory
+    TREE_init(&tree, 0);
 
-    nest = malloc(sizeof(FATNest));
-    nest->count = 0;
-    nest->is_last = NULL;
+    // Directories are loaded a whole level at a time, so their clusters can be read in image order instead of depth first
+    for (level_start = 0; level_start < tree.count && !tree.truncated; level_start = level_end) {
+        level_end = tree.count;
+        loadTreeLevel(fd, bs, fat, &tree, level_start, level_end);
+    }
+
+    TREE_print(&tree);
 
-    traverseDirectory(fd, 0, NULL, nest, bs);
+    TREE_free(&tree);
+    free(fat);
 }
 
 int FAT16_showFile(int fd, char *file_name) {
@@ -68,7 +190,7 @@ int FAT16_showFile(int fd, char *file_name) {
     
     bs = getBootSector(fd);
 
-    file_entry = traverseDirectory(fd, 0, file_name, NULL, bs);
+    file_entry = traverseDirectory(fd, 0, file_name, bs);
 
     if (file_entry == NULL) {
         return -1;
@@ -81,70 +203,152 @@ int FAT16_showFile(int fd, char *file_name) {
     return 0;
 }
 
-BootSector getBootSector(int fd) {
+void FAT16_showUsage(int fd, int top) {
 
-    BootSector bs;
+    FATUsageScan scan;
+    DUReport report;
+    uint64_t root_size;
 
-    lseek(fd, 0, SEEK_SET);
-    read(fd, &bs, BOOT_SECTOR_SIZE);
-    return bs;
+    memset(&scan, 0, sizeof(FATUsageScan));
+    memset(&report, 0, sizeof(DUReport));
+
+    scan.bs = getBootSector(fd);
+    scan.fat = getFAT(fd, scan.bs);
+    scan.report = &report;
+
+    // Root directory lives in its own fixed-size region instead of a cluster chain
+    root_size = scan.bs.BPB_RootEntCnt * DIRECTORY_ENTRY_SIZE;
+    pushUsageDir(&scan, strdup("/"), root_size, root_size);
+
+    walkDirectory(fd, 0, "", scan.fat, scan.bs, visitUsageEntry, &scan);
+
+    while (scan.count > 0) popUsageDir(&scan);
+
+    DU_print(&report, top);
+
+    DU_free(&report);
+    free(scan.stack);
+    free(scan.fat);
 }
 
-void getNextCluster(int fd, int *current_cluster, BootSector bs) {
+int FAT16_checkConsistency(int fd) {
 
-    int fat_offset;
-    
-    fat_offset = bs.BPB_BytsPerSec * bs.BPB_RsvdSecCnt;
+    FATCheckScan scan;
+    CheckLog log;
+    int cluster_count, threads, problems;
 
-    lseek(fd, fat_offset + (*current_cluster * 2), SEEK_SET);
-    read(fd, current_cluster, 2);
+    memset(&scan, 0, sizeof(FATCheckScan));
+    memset(&log, 0, sizeof(CheckLog));
 
-    // fff0-fff6: reserved, fff7: bad cluster, fff8-ffff: last cluster
-    if ((*current_cluster & 0xFFF0) == 0xFFF0) *current_cluster = -1;
+    scan.bs = getBootSector(fd);
+    scan.fat = getFAT(fd, scan.bs);
+
+    cluster_count = getClusterCount(scan.bs);
+
+    // Clusters past the end of the FAT have no entry, chains treat them as ends and the FAT scan stops short of them
+    if (getFATEntryCount(scan.bs) < cluster_count + 2) {
+        CHECK_report(&log, "FAT holds %d entries but the data region has %d clusters", getFATEntryCount(scan.bs), cluster_count);
+    }
+    threads = PARALLEL_getThreadCount(cluster_count);
+
+    scan.chain_refs = calloc(cluster_count + 2, sizeof(uint8_t));
+    scan.entry_refs = calloc(cluster_count + 2, sizeof(uint8_t));
+    scan.logs = calloc(threads, sizeof(CheckLog));
+
+    // Each worker counts the FAT links pointing into clusters from its own range of the FAT
+    PARALLEL_run(cluster_count, threads, countChainRefs, &scan);
+
+    // A single directory pass adds the chain heads and compares file sizes with chain lengths
+    walkDirectory(fd, 0, "", scan.fat, scan.bs, visitCheckEntry, &scan);
+    CHECK_merge(&log, &scan.logs[0]);
+
+    // Any cluster reached more than once is cross-linked
+    PARALLEL_run(cluster_count, threads, checkCrossLinks, &scan);
+
+    for (int i = 0; i < threads; i++) {
+        CHECK_merge(&log, &scan.logs[i]);
+    }
+
+    printf("\n------ Consistency Check ------\n\n");
+    printf("Filesystem: FAT16\n\n");
+    problems = CHECK_print(&log);
+
+    CHECK_free(&log);
+    free(scan.logs);
+    free(scan.chain_refs);
+    free(scan.entry_refs);
+    free(scan.fat);
+
+    return problems;
 }
 
-static int isInternalFile(char* name, int attr) {
-    return (attr & 0x08) == 0x08 || strstr(name, ".") == name || strstr(name, "..") == name;
+void FAT16_listFiles(int fd, FileList *list) {
+
+    FATListScan scan;
+
+    scan.bs = getBootSector(fd);
+    scan.fat = getFAT(fd, scan.bs);
+    scan.list = list;
+
+    walkDirectory(fd, 0, "", scan.fat, scan.bs, visitListEntry, &scan);
+
+    free(scan.fat);
 }
 
-static int isLastEntry(int fd, int *next_entry, int *cluster_id, int *neighbour_cluster, BootSector bs) {
+void FAT16_watch(int fd, int interval) {
 
-    FATDirectoryEntry dir_entry;
-    int cluster_size, data_offset, check;
+    FATWatch watch;
 
-    cluster_size = bs.BPB_SecPerClus * bs.BPB_BytsPerSec;
-    data_offset = bs.BPB_BytsPerSec * (bs.BPB_RsvdSecCnt + (bs.BPB_NumFATs * bs.BPB_FATSz16)) + (bs.BPB_RootEntCnt * DIRECTORY_ENTRY_SIZE);
+    memset(&watch, 0, sizeof(FATWatch));
 
-    do {
+    watch.fd = fd;
+    watch.bs = getBootSector(fd);
+    watch.fat = getFAT(fd, watch.bs);
+    watch.sector_hashes = calloc(watch.bs.BPB_FATSz16, sizeof(uint64_t));
 
-        if (*cluster_id == -1) return 1;
+    hashSectors(&watch, watch.fat, NULL);
 
-        lseek(fd, *next_entry, SEEK_SET);
-        read(fd, &dir_entry, DIRECTORY_ENTRY_SIZE);
-        dir_entry.DIR_Name[10] = '\0';
+    watch.tree.list = listWatchDirectory;
+    watch.tree.ctx = &watch;
+    WATCH_load(&watch.tree, 0);
 
-        *next_entry += DIRECTORY_ENTRY_SIZE;
+    // Runs until interrupted, printing only what changed between polls
+    while (1) {
 
-        check = 1;
-        
-        if (*next_entry == *neighbour_cluster) {
+        sleep(interval);
 
-            getNextCluster(fd, cluster_id, bs);
+        pollChanges(&watch);
+        fflush(stdout);
+    }
+}
 
-            *next_entry = data_offset + ((*cluster_id - 2) * cluster_size);
-            *neighbour_cluster = *next_entry + cluster_size;
+BootSector getBootSector(int fd) {
 
-            check = 0;
-        }
+    BootSector bs;
+
+    IMAGE_lseek(fd, 0, SEEK_SET);
+    IMAGE_read(fd, &bs, sizeof(BootSector));
+    return bs;
+}
+
+void getNextCluster(int fd, int *current_cluster, BootSector bs) {
+
+    int fat_offset;
+    
+    fat_offset = bs.BPB_BytsPerSec * bs.BPB_RsvdSecCnt;
 
-    } while (dir_entry.DIR_Name[0] == 0xE5 || isInternalFile((char*) dir_entry.DIR_Name, dir_entry.DIR_Attr));
+    IMAGE_lseek(fd, fat_offset + (*current_cluster * 2), SEEK_SET);
+    IMAGE_read(fd, current_cluster, 2);
 
-    if (check) *next_entry -= DIRECTORY_ENTRY_SIZE;
+    // fff0-fff6: reserved, fff7: bad cluster, fff8-ffff: last cluster
+    if ((*current_cluster & 0xFFF0) == 0xFFF0) *current_cluster = -1;
+}
 
-    return dir_entry.DIR_Name[0] == 0x00;
+static int isInternalFile(char* name, int attr) {
+    return (attr & 0x08) == 0x08 || strstr(name, ".") == name || strstr(name, "..") == name;
 }
 
-void cleanName(char (*dest)[12], uint8_t* name) {
+void cleanName(char (*dest)[13], uint8_t* name) {
 
     int i;
     for (i = 0; i < 8; i++) {
@@ -173,52 +377,11 @@ void cleanName(char (*dest)[12], uint8_t* name) {
     (*dest)[i] = '\0';
 }
 
-static char* getNestFormat(FATNest nest) {
-
-    char* nesting;
-    int i = 0, nest_i = 0;
-
-    if (nest.count == 0) return NULL;
-
-    nesting = malloc((nest.count * 4) + 1);
-
-    for (i = 0, nest_i = 0; nest_i < nest.count; nest_i++, i++) {
-
-        if (!nest.is_last[nest_i]) {
-            nesting[i] = 0xE2;
-            nesting[i + 1] = 0x94;
-            nesting[i + 2] = 0x82;
-            i += 3;
-        }
-
-        nesting[i] = '\t';
-    }
-
-    nesting[i] = '\0';
-
-    return realloc(nesting, strlen(nesting) + 1);
-}
-
-FATNest* clone(FATNest *nest, int is_last) {
-
-    FATNest* nest_copy = malloc(sizeof(FATNest));
-
-    nest_copy->count = nest->count + 1;
-    nest_copy->is_last = malloc(nest_copy->count * sizeof(int));
-
-    for (int i = 0; i < nest->count; i++) {
-        nest_copy->is_last[i] = nest->is_last[i];
-    }
-    nest_copy->is_last[nest->count] = is_last;
-
-    return nest_copy;
-}
-
-FATDirectoryEntry* traverseDirectory(int fd, int cluster_id, char* file_name, FATNest *nest, BootSector bs) {
+FATDirectoryEntry* traverseDirectory(int fd, int cluster_id, char* file_name, BootSector bs) {
 
     FATDirectoryEntry *dir_entry, *ret_dir_entry;
-    int is_last, cluster_size, data_offset, next_entry, neighbour_cluster;
-    char name[12], *nesting;
+    int cluster_size, data_offset, next_entry, neighbour_cluster;
+    char name[13];
 
     // If 0 provided, read root directory
     if (cluster_id == 0) {
@@ -240,8 +403,8 @@ FATDirectoryEntry* traverseDirectory(int fd, int cluster_id, char* file_name, FA
 
     do {
 
-        lseek(fd, next_entry, SEEK_SET);
-        read(fd, dir_entry, DIRECTORY_ENTRY_SIZE);
+        IMAGE_lseek(fd, next_entry, SEEK_SET);
+        IMAGE_read(fd, dir_entry, DIRECTORY_ENTRY_SIZE);
 
         next_entry += DIRECTORY_ENTRY_SIZE;
 
@@ -261,45 +424,21 @@ FATDirectoryEntry* traverseDirectory(int fd, int cluster_id, char* file_name, FA
         
         if (isInternalFile(name, dir_entry->DIR_Attr)) continue;
 
-        if (nest != NULL) {
-        
-            nesting = getNestFormat(*nest);
-
-            if (isLastEntry(fd, &next_entry, &cluster_id, &neighbour_cluster, bs)) {
-                printf("%s└ %s\n", (nesting != NULL) ? nesting : "", name);
-                is_last = 1;
-            }
-            else {
-                printf("%s├ %s\n", (nesting != NULL) ? nesting : "", name);
-                is_last = 0;
-            }
-
-            if (nesting != NULL) free(nesting);
-        }
-
         if ((dir_entry->DIR_Attr & 0x30) == 0x10) {
 
-            if (nest == NULL) {
-
-                ret_dir_entry = traverseDirectory(fd, dir_entry->DIR_FstClusLO, file_name, NULL, bs);
+            ret_dir_entry = traverseDirectory(fd, dir_entry->DIR_FstClusLO, file_name, bs);
 
-                if (ret_dir_entry != NULL) {
-                    free(dir_entry);
-                    return ret_dir_entry;
-                }
-            }
-            else {
-                traverseDirectory(fd, dir_entry->DIR_FstClusLO, NULL, clone(nest, is_last), bs);
+            if (ret_dir_entry != NULL) {
+                free(dir_entry);
+                return ret_dir_entry;
             }
         }
-        else if (file_name != NULL && strcmp(name, file_name) == 0) {
+        else if (strcmp(name, file_name) == 0) {
             return dir_entry;
         }
 
     } while (cluster_id != -1);
 
-    if (nest != NULL) free(nest->is_last);
-    free(nest);
     free(dir_entry);
     return NULL;
 }
@@ -318,7 +457,7 @@ static void showFile(int fd, FATDirectoryEntry *file_entry, BootSector bs) {
     next_entry = data_offset + ((cluster_id - 2) * cluster_size);
     neighbour_cluster = next_entry + cluster_size;
 
-    lseek(fd, next_entry, SEEK_SET);
+    IMAGE_lseek(fd, next_entry, SEEK_SET);
 
     i = 0;
     
@@ -333,13 +472,13 @@ static void showFile(int fd, FATDirectoryEntry *file_entry, BootSector bs) {
             next_entry = data_offset + ((cluster_id - 2) * cluster_size);
             neighbour_cluster = next_entry + cluster_size;
 
-            lseek(fd, next_entry, SEEK_SET);
+            IMAGE_lseek(fd, next_entry, SEEK_SET);
         }
 
         bytes_to_read = ((file_size - i) < cluster_size) ? file_size - i : cluster_size;
 
         data = realloc(data, bytes_to_read + 1);
-        read(fd, data, bytes_to_read);
+        IMAGE_read(fd, data, bytes_to_read);
         data[bytes_to_read] = '\0';
         printf("%s", data);
 
@@ -347,4 +486,1032 @@ static void showFile(int fd, FATDirectoryEntry *file_entry, BootSector bs) {
     }
 
     free(data);
-}
\ No newline at end of file
+}
+
+static int getClusterSize(BootSector bs) {
+    return bs.BPB_SecPerClus * bs.BPB_BytsPerSec;
+}
+
+static int getRootOffset(BootSector bs) {
+    return bs.BPB_BytsPerSec * (bs.BPB_RsvdSecCnt + (bs.BPB_NumFATs * bs.BPB_FATSz16));
+}
+
+static int getDataOffset(BootSector bs) {
+    return getRootOffset(bs) + (bs.BPB_RootEntCnt * DIRECTORY_ENTRY_SIZE);
+}
+
+static uint32_t getTotalSectors(BootSector bs) {
+
+    // Volumes of 32 MB and up don't fit the 16 bit count, which is then 0 and the 32 bit one holds it
+    return (bs.BPB_TotSec16 != 0) ? bs.BPB_TotSec16 : bs.BPB_TotSec32;
+}
+
+static int getClusterCount(BootSector bs) {
+
+    int64_t root_dir_sectors, data_sectors;
+
+    root_dir_sectors = ((bs.BPB_RootEntCnt * DIRECTORY_ENTRY_SIZE) + (bs.BPB_BytsPerSec - 1)) / bs.BPB_BytsPerSec;
+    data_sectors = (int64_t) getTotalSectors(bs) - (bs.BPB_RsvdSecCnt + (bs.BPB_NumFATs * bs.BPB_FATSz16) + root_dir_sectors);
+
+    // Metadata bigger than the volume leaves no data region at all
+    if (data_sectors < 0) return 0;
+
+    return (data_sectors / bs.BPB_SecPerClus > INT32_MAX) ? INT32_MAX : data_sectors / bs.BPB_SecPerClus;
+}
+
+static int getFATEntryCount(BootSector bs) {
+    return bs.BPB_FATSz16 * bs.BPB_BytsPerSec / 2;
+}
+
+static uint16_t* getFAT(int fd, BootSector bs) {
+
+    uint16_t *fat;
+    int fat_size;
+
+    fat_size = bs.BPB_FATSz16 * bs.BPB_BytsPerSec;
+
+    fat = malloc(fat_size);
+    IMAGE_pread(fd, fat, fat_size, bs.BPB_BytsPerSec * bs.BPB_RsvdSecCnt);
+
+    return fat;
+}
+
+static int isEndOfChain(uint16_t cluster_id, BootSector bs) {
+    // fff0-fff6: reserved, fff7: bad cluster, fff8-ffff: last cluster
+    return (cluster_id & 0xFFF0) == 0xFFF0 || cluster_id < 2 || cluster_id >= getClusterCount(bs) + 2 || cluster_id >= getFATEntryCount(bs);
+}
+
+static FATDirectoryEntry* getDirectory(int fd, int cluster_id, uint16_t *fat, BootSector bs, int *total_entries) {
+
+    FATDirectoryEntry *entries = NULL;
+    int cluster_size, entries_per_cluster, max_entries, chain_length = 0;
+
+    // If 0 provided, read root directory
+    if (cluster_id == 0) {
+
+        max_entries = bs.BPB_RootEntCnt;
+        entries = malloc(max_entries * DIRECTORY_ENTRY_SIZE);
+        IMAGE_pread(fd, entries, max_entries * DIRECTORY_ENTRY_SIZE, getRootOffset(bs));
+    }
+    else {
+
+        cluster_size = getClusterSize(bs);
+        entries_per_cluster = cluster_size / DIRECTORY_ENTRY_SIZE;
+        max_entries = 0;
+
+        // Chains longer than the cluster count can only be loops
+        while (!isEndOfChain(cluster_id, bs) && chain_length++ <= getClusterCount(bs)) {
+
+            entries = realloc(entries, (max_entries + entries_per_cluster) * DIRECTORY_ENTRY_SIZE);
+            IMAGE_pread(fd, &entries[max_entries], cluster_size, getDataOffset(bs) + ((off_t) (cluster_id - 2) * cluster_size));
+
+            max_entries += entries_per_cluster;
+            cluster_id = fat[cluster_id];
+        }
+    }
+
+    // A free entry marks the end of the directory
+    for (*total_entries = 0; *total_entries < max_entries; (*total_entries)++) {
+        if (entries[*total_entries].DIR_Name[0] == 0x00) break;
+    }
+
+    return entries;
+}
+
+static void walkDirectory(int fd, int cluster_id, char *path, uint16_t *fat, BootSector bs, void (*visit)(char *path, char *name, FATDirectoryEntry *entry, void *ctx), void *ctx) {
+
+    FATDirectoryEntry *entries;
+    int total_entries;
+    char name[13], *entry_path;
+
+    entries = getDirectory(fd, cluster_id, fat, bs, &total_entries);
+
+    for (int i = 0; i < total_entries; i++) {
+
+        if (entries[i].DIR_Name[0] == 0xE5) continue;
+        if (entries[i].DIR_Name[0] == 0x05) entries[i].DIR_Name[0] = 0xE5;
+
+        cleanName(&name, entries[i].DIR_Name);
+
+        if (isInternalFile(name, entries[i].DIR_Attr)) continue;
+
+        entry_path = malloc(strlen(path) + strlen(name) + 2);
+        sprintf(entry_path, "%s/%s", path, name);
+
+        visit(entry_path, name, &entries[i], ctx);
+
+        if ((entries[i].DIR_Attr & 0x30) == 0x10 && entries[i].DIR_FstClusLO != 0) {
+            walkDirectory(fd, entries[i].DIR_FstClusLO, entry_path, fat, bs, visit, ctx);
+        }
+
+        free(entry_path);
+    }
+
+    free(entries);
+}
+
+static time_t getModificationTime(FATDirectoryEntry *entry) {
+
+    struct tm date;
+
+    memset(&date, 0, sizeof(struct tm));
+
+    // Dates are stored as 7 bits of years since 1980, 4 of month and 5 of day
+    date.tm_year = (entry->DIR_WrtDate >> 9) + 80;
+    date.tm_mon = ((entry->DIR_WrtDate >> 5) & 0x0F) - 1;
+    date.tm_mday = entry->DIR_WrtDate & 0x1F;
+
+    // Times are stored as 5 bits of hours, 6 of minutes and 5 of 2-second units
+    date.tm_hour = entry->DIR_WrtTime >> 11;
+    date.tm_min = (entry->DIR_WrtTime >> 5) & 0x3F;
+    date.tm_sec = (entry->DIR_WrtTime & 0x1F) * 2;
+    date.tm_isdst = -1;
+
+    return mktime(&date);
+}
+
+static int getChainLength(uint16_t *fat, int cluster_id, BootSector bs) {
+
+    int chain_length = 0, cluster_count;
+
+    cluster_count = getClusterCount(bs);
+
+    // Chains longer than the cluster count can only be loops
+    while (!isEndOfChain(cluster_id, bs) && chain_length <= cluster_count) {
+        cluster_id = fat[cluster_id];
+        chain_length++;
+    }
+
+    return chain_length;
+}
+
+static int isAncestor(char *dir_path, char *path) {
+
+    int length;
+
+    if (strcmp(dir_path, "/") == 0) return 1;
+
+    length = strlen(dir_path);
+
+    return strncmp(dir_path, path, length) == 0 && path[length] == '/';
+}
+
+static void pushUsageDir(FATUsageScan *scan, char *path, uint64_t size, uint64_t allocated) {
+
+    if (scan->count == scan->capacity) {
+        scan->capacity = (scan->capacity == 0) ? 16 : scan->capacity * 2;
+        scan->stack = realloc(scan->stack, sizeof(DUEntry) * scan->capacity);
+    }
+
+    scan->stack[scan->count].path = path;
+    scan->stack[scan->count].size = size;
+    scan->stack[scan->count].allocated = allocated;
+    scan->count++;
+}
+
+static void popUsageDir(FATUsageScan *scan) {
+
+    DUEntry *dir;
+
+    dir = &scan->stack[--scan->count];
+
+    // Totals are complete once the walk leaves the directory
+    DU_add(scan->report, dir->path, dir->size, dir->allocated);
+}
+
+static void visitUsageEntry(char *path, char *name, FATDirectoryEntry *entry, void *ctx) {
+
+    FATUsageScan *scan = ctx;
+    uint64_t size, allocated;
+    int is_dir;
+
+    (void) name;
+
+    // Walk is depth first, so directories not containing this entry are already finished
+    while (scan->count > 0 && !isAncestor(scan->stack[scan->count - 1].path, path)) popUsageDir(scan);
+
+    is_dir = (entry->DIR_Attr & 0x30) == 0x10;
+
+    allocated = (uint64_t) getChainLength(scan->fat, entry->DIR_FstClusLO, scan->bs) * getClusterSize(scan->bs);
+    size = is_dir ? allocated : entry->DIR_FileSize;
+
+    for (int i = 0; i < scan->count; i++) {
+        scan->stack[i].size += size;
+        scan->stack[i].allocated += allocated;
+    }
+
+    if (is_dir) pushUsageDir(scan, strdup(path), size, allocated);
+}
+
+static FATEntryCounts countEntries(uint16_t *fat, int total_entries) {
+
+    FATEntryCounts counts;
+    int i = 0;
+
+    memset(&counts, 0, sizeof(FATEntryCounts));
+
+#ifdef __SSE2__
+    __m128i free_value, bad_value, end_mask, matches;
+
+    free_value = _mm_setzero_si128();
+    bad_value = _mm_set1_epi16((short) 0xFFF7);
+    end_mask = _mm_set1_epi16((short) 0xFFF8);
+
+    // Compare 8 entries at once, each matching 16-bit lane sets 2 bits of the byte mask
+    for (; i + 8 <= total_entries; i += 8) {
+
+        matches = _mm_loadu_si128((__m128i*) (fat + i));
+
+        counts.free_clusters += __builtin_popcount(_mm_movemask_epi8(_mm_cmpeq_epi16(matches, free_value))) / 2;
+        counts.bad_clusters += __builtin_popcount(_mm_movemask_epi8(_mm_cmpeq_epi16(matches, bad_value))) / 2;
+        counts.end_of_chain += __builtin_popcount(_mm_movemask_epi8(_mm_cmpeq_epi16(_mm_and_si128(matches, end_mask), end_mask))) / 2;
+    }
+#endif
+
+    for (; i < total_entries; i++) {
+
+        if (fat[i] == 0x0000) counts.free_clusters++;
+        else if (fat[i] == 0xFFF7) counts.bad_clusters++;
+        else if (fat[i] >= 0xFFF8) counts.end_of_chain++;
+    }
+
+    return counts;
+}
+
+static void visitAnalysisEntry(char *path, char *name, FATDirectoryEntry *entry, void *ctx) {
+
+    FATAnalysis *analysis = ctx;
+    uint32_t chain_length = 0, cluster_count;
+    int cluster_id, fragmented = 0;
+
+    (void) path;
+    (void) name;
+
+    cluster_id = entry->DIR_FstClusLO;
+    cluster_count = getClusterCount(analysis->bs);
+
+    // Chains longer than the cluster count can only be loops
+    while (!isEndOfChain(cluster_id, analysis->bs) && chain_length <= cluster_count) {
+
+        analysis->reachable[cluster_id] = 1;
+        chain_length++;
+
+        if (!isEndOfChain(analysis->fat[cluster_id], analysis->bs) && analysis->fat[cluster_id] != cluster_id + 1) fragmented = 1;
+
+        cluster_id = analysis->fat[cluster_id];
+    }
+
+    if (chain_length == 0) return;
+
+    analysis->chains++;
+    analysis->chained_clusters += chain_length;
+    analysis->fragmented_chains += fragmented;
+
+    if (chain_length > analysis->longest_chain) analysis->longest_chain = chain_length;
+}
+
+static void countChainRefs(int worker, int begin, int end, void *ctx) {
+
+    FATCheckScan *scan = ctx;
+    uint16_t next_cluster;
+    int cluster_count, entry_count;
+
+    cluster_count = getClusterCount(scan->bs);
+    entry_count = getFATEntryCount(scan->bs);
+
+    for (int i = begin + 2; i < end + 2 && i < entry_count; i++) {
+
+        next_cluster = scan->fat[i];
+
+        if (next_cluster == 0x0000 || (next_cluster & 0xFFF0) == 0xFFF0) continue;
+
+        if (next_cluster < 2 || next_cluster >= cluster_count + 2) {
+            CHECK_report(&scan->logs[worker], "Cluster %d points to cluster %u, outside the data region", i, next_cluster);
+            continue;
+        }
+
+        CHECK_addRef(&scan->chain_refs[next_cluster]);
+    }
+}
+
+static void visitCheckEntry(char *path, char *name, FATDirectoryEntry *entry, void *ctx) {
+
+    FATCheckScan *scan = ctx;
+    uint32_t chain_length = 0, expected_length, cluster_count;
+    int cluster_id, is_dir;
+
+    (void) name;
+
+    is_dir = (entry->DIR_Attr & 0x30) == 0x10;
+    cluster_id = entry->DIR_FstClusLO;
+    cluster_count = getClusterCount(scan->bs);
+
+    if (cluster_id != 0 && (cluster_id < 2 || cluster_id >= (int) cluster_count + 2)) {
+        CHECK_report(&scan->logs[0], "%s starts at cluster %d, outside the data region", path, cluster_id);
+        return;
+    }
+
+    if (cluster_id != 0) CHECK_addRef(&scan->entry_refs[cluster_id]);
+
+    // Chains longer than the cluster count can only be loops
+    while (!isEndOfChain(cluster_id, scan->bs) && chain_length <= cluster_count) {
+
+        if (scan->fat[cluster_id] == 0x0000) {
+            CHECK_report(&scan->logs[0], "%s runs into free cluster %d", path, cluster_id);
+            break;
+        }
+
+        chain_length++;
+        cluster_id = scan->fat[cluster_id];
+    }
+
+    if (chain_length > cluster_count) {
+        CHECK_report(&scan->logs[0], "%s has a looping cluster chain", path);
+        return;
+    }
+
+    if (is_dir) {
+        if (chain_length == 0) CHECK_report(&scan->logs[0], "%s is a directory without clusters", path);
+        return;
+    }
+
+    expected_length = (entry->DIR_FileSize + getClusterSize(scan->bs) - 1) / getClusterSize(scan->bs);
+
+    if (chain_length != expected_length) {
+        CHECK_report(&scan->logs[0], "%s has size %u (%u clusters) but a chain of %u clusters", path, entry->DIR_FileSize, expected_length, chain_length);
+    }
+}
+
+static void checkCrossLinks(int worker, int begin, int end, void *ctx) {
+
+    FATCheckScan *scan = ctx;
+
+    for (int i = begin + 2; i < end + 2; i++) {
+
+        if (scan->chain_refs[i] + scan->entry_refs[i] > 1) {
+            CHECK_report(&scan->logs[worker], "Cluster %d is cross-linked (%d references)", i, scan->chain_refs[i] + scan->entry_refs[i]);
+        }
+    }
+}
+
+static void visitListEntry(char *path, char *name, FATDirectoryEntry *entry, void *ctx) {
+
+    FATListScan *scan = ctx;
+    FileEntry *file_entry;
+    int is_dir;
+
+    (void) name;
+
+    is_dir = (entry->DIR_Attr & 0x30) == 0x10;
+    file_entry = FILELIST_add(scan->list, strdup(path), is_dir ? 0 : entry->DIR_FileSize, getModificationTime(entry), is_dir);
+
+    if (!is_dir) mapChain(scan->bs, scan->fat, entry, file_entry);
+}
+
+static void hashSectors(FATWatch *watch, uint16_t *fat, uint8_t *changed_sectors) {
+
+    uint64_t hash;
+
+    for (int i = 0; i < watch->bs.BPB_FATSz16; i++) {
+
+        hash = HASH_compute((uint8_t*) fat + i * watch->bs.BPB_BytsPerSec, watch->bs.BPB_BytsPerSec, i);
+
+        if (hash != watch->sector_hashes[i] && changed_sectors != NULL) changed_sectors[i] = 1;
+        watch->sector_hashes[i] = hash;
+    }
+}
+
+static void addWatchCluster(FATWatch *watch, uint64_t dir_id, uint16_t cluster, uint64_t hash) {
+
+    if (watch->cluster_count == watch->cluster_capacity) {
+        watch->cluster_capacity = (watch->cluster_capacity == 0) ? 64 : watch->cluster_capacity * 2;
+        watch->clusters = realloc(watch->clusters, sizeof(FATWatchCluster) * watch->cluster_capacity);
+    }
+
+    watch->clusters[watch->cluster_count].dir_id = dir_id;
+    watch->clusters[watch->cluster_count].cluster = cluster;
+    watch->clusters[watch->cluster_count].hash = hash;
+    watch->cluster_count++;
+}
+
+static int listWatchDirectory(uint64_t id, WatchEntry **entries, uint64_t *fingerprint, void *ctx) {
+
+    FATWatch *watch = ctx;
+    FATDirectoryEntry *dir_entries, dir_entry;
+    WatchEntry *entry;
+    uint16_t *chain = NULL;
+    uint64_t offset;
+    int total_entries, count = 0, cluster_id = 0, cluster_size, entries_per_cluster, chain_length = 0;
+    char name[13];
+
+    cluster_size = getClusterSize(watch->bs);
+    entries_per_cluster = cluster_size / DIRECTORY_ENTRY_SIZE;
+
+    // Ids are the offsets of the entries in the image, which stay put while a file grows or is renamed in place
+    if (id != 0) {
+
+        if (IMAGE_pread(watch->fd, &dir_entry, DIRECTORY_ENTRY_SIZE, id) != DIRECTORY_ENTRY_SIZE || (dir_entry.DIR_Attr & 0x30) != 0x10) return -1;
+        if ((cluster_id = dir_entry.DIR_FstClusLO) == 0) return -1;
+
+        chain = malloc(sizeof(uint16_t) * (getChainLength(watch->fat, cluster_id, watch->bs) + 1));
+
+        for (int cluster = cluster_id; !isEndOfChain(cluster, watch->bs) && chain_length <= getClusterCount(watch->bs); cluster = watch->fat[cluster]) {
+            chain[chain_length++] = cluster;
+        }
+    }
+
+    dir_entries = getDirectory(watch->fd, cluster_id, watch->fat, watch->bs, &total_entries);
+
+    // Every cluster is recorded with its hash, so polls can tell which directory a changed cluster or FAT sector belongs to
+    for (int i = 0; i < watch->cluster_count; i++) {
+        if (watch->clusters[i].dir_id == id) watch->clusters[i--] = watch->clusters[--watch->cluster_count];
+    }
+
+    if (id == 0) {
+        addWatchCluster(watch, id, 0, HASH_compute(dir_entries, watch->bs.BPB_RootEntCnt * DIRECTORY_ENTRY_SIZE, 0));
+    }
+
+    for (int i = 0; i < chain_length; i++) {
+        addWatchCluster(watch, id, chain[i], HASH_compute((uint8_t*) dir_entries + (size_t) i * cluster_size, cluster_size, chain[i]));
+    }
+
+    // Raw entries, so any change to a name, size or time shows up
+    *fingerprint = HASH_compute(dir_entries, total_entries * DIRECTORY_ENTRY_SIZE, id);
+    *entries = malloc(sizeof(WatchEntry) * (total_entries + 1));
+
+    for (int i = 0; i < total_entries; i++) {
+
+        if (dir_entries[i].DIR_Name[0] == 0xE5) continue;
+        if (dir_entries[i].DIR_Name[0] == 0x05) dir_entries[i].DIR_Name[0] = 0xE5;
+
+        cleanName(&name, dir_entries[i].DIR_Name);
+
+        if (isInternalFile(name, dir_entries[i].DIR_Attr)) continue;
+
+        if (id == 0) offset = getRootOffset(watch->bs) + (uint64_t) i * DIRECTORY_ENTRY_SIZE;
+        else offset = getDataOffset(watch->bs) + (uint64_t) (chain[i / entries_per_cluster] - 2) * cluster_size + (uint64_t) (i % entries_per_cluster) * DIRECTORY_ENTRY_SIZE;
+
+        entry = &(*entries)[count++];
+
+        entry->name = strdup(name);
+        entry->id = offset;
+        entry->is_dir = (dir_entries[i].DIR_Attr & 0x30) == 0x10 && dir_entries[i].DIR_FstClusLO != 0;
+        entry->size = entry->is_dir ? 0 : dir_entries[i].DIR_FileSize;
+        entry->mtime = getModificationTime(&dir_entries[i]);
+    }
+
+    free(dir_entries);
+    free(chain);
+
+    return count;
+}
+
+static void pollChanges(FATWatch *watch) {
+
+    ImageRead *reads;
+    FATWatchCluster *cluster;
+    struct timespec write_time;
+    uint64_t *dirs;
+    uint16_t *fat;
+    uint8_t *data, *changed_sectors;
+    int *records;
+    int cluster_size, root_size, slot_size, kept = 0, dir_count = 0, read_count = 0;
+
+    // FAT keeps no write time of its own, but an image file does, so a quiet poll costs a single stat.
+    // Writes within the tick the time was last set in can't be told apart, so that tick is always looked at
+    if (IMAGE_getWriteTime(watch->fd, &write_time) == 0) {
+
+        if (write_time.tv_sec == watch->write_time.tv_sec && write_time.tv_nsec == watch->write_time.tv_nsec) return;
+        if (write_time.tv_sec < time(NULL) - 1) watch->write_time = write_time;
+    }
+
+    fat = getFAT(watch->fd, watch->bs);
+    changed_sectors = calloc(watch->bs.BPB_FATSz16 + 1, 1);
+
+    // Writes that allocate or free clusters touch the FAT, and growing or shrinking directories change their own chain there
+    hashSectors(watch, fat, changed_sectors);
+
+    free(watch->fat);
+    watch->fat = fat;
+
+    // Clusters of directories no longer in the tree are dropped
+    for (int i = 0; i < watch->cluster_count; i++) {
+        if (WATCH_findDirectory(&watch->tree, watch->clusters[i].dir_id) != NULL) watch->clusters[kept++] = watch->clusters[i];
+    }
+
+    watch->cluster_count = kept;
+
+    cluster_size = getClusterSize(watch->bs);
+    root_size = watch->bs.BPB_RootEntCnt * DIRECTORY_ENTRY_SIZE;
+    slot_size = (cluster_size > root_size) ? cluster_size : root_size;
+
+    reads = malloc(sizeof(ImageRead) * (watch->cluster_count + 1));
+    records = malloc(sizeof(int) * (watch->cluster_count + 1));
+    dirs = malloc(sizeof(uint64_t) * (watch->cluster_count + 1));
+
+    // Directories whose chain moved are listed again anyway, so only the clusters of the others are read to compare hashes
+    for (int i = 0; i < watch->cluster_count; i++) {
+
+        cluster = &watch->clusters[i];
+
+        if (cluster->cluster != 0 && changed_sectors[cluster->cluster * 2 / watch->bs.BPB_BytsPerSec]) dirs[dir_count++] = cluster->dir_id;
+    }
+
+    qsort(dirs, dir_count, sizeof(uint64_t), compareIds);
+
+    for (int i = 0; i < watch->cluster_count; i++) {
+        if (bsearch(&watch->clusters[i].dir_id, dirs, dir_count, sizeof(uint64_t), compareIds) == NULL) records[read_count++] = i;
+    }
+
+    data = malloc((size_t) read_count * slot_size + 1);
+
+    for (int i = 0; i < read_count; i++) {
+
+        cluster = &watch->clusters[records[i]];
+
+        reads[i].offset = (cluster->cluster == 0) ? getRootOffset(watch->bs) : getDataOffset(watch->bs) + (off_t) (cluster->cluster - 2) * cluster_size;
+        reads[i].length = (cluster->cluster == 0) ? root_size : cluster_size;
+        reads[i].buffer = data + (size_t) i * slot_size;
+    }
+
+    IMAGE_readBatch(watch->fd, reads, read_count);
+
+    // Renames, new entries and size or time updates only show in the directory clusters.
+    // Reads come back sorted by offset, but each buffer slot still matches its cluster
+    for (int i = 0; i < read_count; i++) {
+
+        cluster = &watch->clusters[records[i]];
+
+        if (HASH_compute(data + (size_t) i * slot_size, (cluster->cluster == 0) ? root_size : cluster_size, cluster->cluster) != cluster->hash) {
+            dirs[dir_count++] = cluster->dir_id;
+        }
+    }
+
+    qsort(dirs, dir_count, sizeof(uint64_t), compareIds);
+
+    // Only directories owning a changed cluster or chain are parsed again
+    for (int i = 0; i < dir_count; i++) {
+        if (i == 0 || dirs[i] != dirs[i - 1]) WATCH_refresh(&watch->tree, dirs[i]);
+    }
+
+    free(changed_sectors);
+    free(data);
+    free(dirs);
+    free(records);
+    free(reads);
+}
+
+static int compareIds(const void *a, const void *b) {
+
+    uint64_t id_a = *(const uint64_t*) a, id_b = *(const uint64_t*) b;
+
+    if (id_a == id_b) return 0;
+    return (id_a < id_b) ? -1 : 1;
+}
+
+static void mapChain(BootSector bs, uint16_t *fat, FATDirectoryEntry *entry, FileEntry *file_entry) {
+
+    uint64_t logical = 0;
+    uint32_t chain_length = 0, cluster_count;
+    int cluster_id, cluster_size;
+
+    cluster_id = entry->DIR_FstClusLO;
+    cluster_size = getClusterSize(bs);
+    cluster_count = getClusterCount(bs);
+
+    // Chains longer than the cluster count can only be loops
+    while (!isEndOfChain(cluster_id, bs) && chain_length++ <= cluster_count && logical < file_entry->size) {
+
+        FILELIST_addExtent(file_entry, logical, getDataOffset(bs) + (uint64_t) (cluster_id - 2) * cluster_size, cluster_size);
+
+        logical += cluster_size;
+        cluster_id = fat[cluster_id];
+    }
+}
+
+static void loadTreeLevel(int fd, BootSector bs, uint16_t *fat, Tree *tree, int begin, int end) {
+
+    ImageRead *reads;
+    uint8_t *data;
+    uint64_t data_size, data_offset, level_size, slice_size;
+    int cluster_size, cluster_id, dir_count = 0, read_count, first, last, *dirs, *sizes;
+
+    cluster_size = getClusterSize(bs);
+
+    for (int i = begin; i < end; i++) {
+        if (tree->entries[i].is_dir) dir_count++;
+    }
+
+    // Level buffers count against --memory like the tree itself, running out just leaves the tree incomplete
+    level_size = (uint64_t) dir_count * 2 * sizeof(int);
+
+    if (ARENA_reserve(level_size) < 0) {
+        tree->truncated = 1;
+        return;
+    }
+
+    dirs = malloc(sizeof(int) * dir_count);
+    sizes = malloc(sizeof(int) * dir_count);
+    dir_count = 0;
+
+    for (int i = begin; i < end; i++) {
+
+        if (!tree->entries[i].is_dir) continue;
+
+        dirs[dir_count] = i;
+        sizes[dir_count++] = (tree->entries[i].id == 0) ? bs.BPB_RootEntCnt * DIRECTORY_ENTRY_SIZE : getChainLength(fat, tree->entries[i].id, bs) * cluster_size;
+    }
+
+    // One sweep per slice of the level, so wide levels don't need all of it in memory
+    for (first = 0; first < dir_count && !tree->truncated; first = last) {
+
+        data_size = 0;
+        read_count = 0;
+
+        for (last = first; last < dir_count; last++) {
+
+            if (last > first && data_size + sizes[last] > TREE_BATCH_SIZE) break;
+
+            data_size += sizes[last];
+            read_count += (tree->entries[dirs[last]].id == 0) ? 1 : sizes[last] / cluster_size;
+        }
+
+        slice_size = data_size + sizeof(ImageRead) * read_count;
+
+        if (ARENA_reserve(slice_size) < 0) {
+            tree->truncated = 1;
+            break;
+        }
+
+        data = malloc(data_size);
+        reads = malloc(sizeof(ImageRead) * read_count);
+        read_count = 0;
+        data_offset = 0;
+
+        for (int i = first; i < last; i++) {
+
+            // The root directory has a fixed region of its own, everything else is a cluster chain
+            if (tree->entries[dirs[i]].id == 0) {
+
+                reads[read_count].offset = getRootOffset(bs);
+                reads[read_count].length = sizes[i];
+                reads[read_count].buffer = data + data_offset;
+                read_count++;
+            }
+            else {
+
+                cluster_id = tree->entries[dirs[i]].id;
+
+                for (int j = 0; j < sizes[i] / cluster_size; j++) {
+
+                    reads[read_count].offset = getDataOffset(bs) + ((off_t) (cluster_id - 2) * cluster_size);
+                    reads[read_count].length = cluster_size;
+                    reads[read_count].buffer = data + data_offset + (uint64_t) j * cluster_size;
+                    read_count++;
+
+                    cluster_id = fat[cluster_id];
+                }
+            }
+
+            data_offset += sizes[i];
+        }
+
+        IMAGE_readBatch(fd, reads, read_count);
+
+        // Parsed in the order the directories were found, which keeps every listing in on-disk order
+        data_offset = 0;
+
+        for (int i = first; i < last; i++) {
+            addTreeEntries(tree, dirs[i], (FATDirectoryEntry*) (data + data_offset), sizes[i] / DIRECTORY_ENTRY_SIZE);
+            data_offset += sizes[i];
+        }
+
+        free(reads);
+        free(data);
+        ARENA_release(slice_size);
+    }
+
+    free(sizes);
+    free(dirs);
+
+    ARENA_release(level_size);
+}
+
+static void addTreeEntries(Tree *tree, int dir, FATDirectoryEntry *entries, int total_entries) {
+
+    char name[13];
+
+    for (int i = 0; i < total_entries; i++) {
+
+        // A free entry marks the end of the directory
+        if (entries[i].DIR_Name[0] == 0x00) break;
+        if (entries[i].DIR_Name[0] == 0xE5) continue;
+        if (entries[i].DIR_Name[0] == 0x05) entries[i].DIR_Name[0] = 0xE5;
+
+        cleanName(&name, entries[i].DIR_Name);
+
+        if (isInternalFile(name, entries[i].DIR_Attr)) continue;
+
+        // Cluster 0 would be the root directory again
+        TREE_add(tree, dir, name, strlen(name), entries[i].DIR_FstClusLO, (entries[i].DIR_Attr & 0x30) == 0x10 && entries[i].DIR_FstClusLO != 0);
+    }
+}
+
+static int readEntry(FATMount *mount, uint64_t id, FATDirectoryEntry *entry) {
+
+    uint64_t root_offset, data_end;
+
+    root_offset = getRootOffset(mount->bs);
+    data_end = getDataOffset(mount->bs) + (uint64_t) getClusterCount(mount->bs) * getClusterSize(mount->bs);
+
+    // Ids are image offsets, and only the root region and the clusters after it hold entries, 32 bytes apart
+    if (id < root_offset || id >= data_end || (id - root_offset) % DIRECTORY_ENTRY_SIZE != 0) return -1;
+
+    if (IMAGE_pread(mount->fd, entry, DIRECTORY_ENTRY_SIZE, id) != DIRECTORY_ENTRY_SIZE) return -1;
+
+    // Long name parts only describe the entry that follows them
+    if (entry->DIR_Attr == 0x0F) return -1;
+
+    return (entry->DIR_Name[0] == 0x00 || entry->DIR_Name[0] == 0xE5) ? -1 : 0;
+}
+
+static uint64_t getEntryOffset(FATMount *mount, int index) {
+
+    int cluster_size, entries_per_cluster;
+
+    if (mount->dir_id == 0) return getRootOffset(mount->bs) + (uint64_t) index * DIRECTORY_ENTRY_SIZE;
+
+    cluster_size = getClusterSize(mount->bs);
+    entries_per_cluster = cluster_size / DIRECTORY_ENTRY_SIZE;
+
+    return getDataOffset(mount->bs) + (uint64_t) (mount->dir_clusters[index / entries_per_cluster] - 2) * cluster_size + (index % entries_per_cluster) * DIRECTORY_ENTRY_SIZE;
+}
+
+static void getLongName(FATDirectoryEntry *entries, int index, char *long_name) {
+
+    FATLongNameEntry *part;
+    uint16_t units[13];
+    uint8_t checksum = 0;
+    int length = 0;
+
+    for (int i = 0; i < 11; i++) {
+        checksum = ((checksum & 1) << 7) + (checksum >> 1) + entries[index].DIR_Name[i];
+    }
+
+    // Parts sit right before their short entry in reverse order, the one flagged 0x40 holds the end of the name
+    for (int order = 1; order <= index; order++) {
+
+        part = (FATLongNameEntry*) &entries[index - order];
+
+        if (part->LDIR_Attr != 0x0F || (part->LDIR_Ord & 0x1F) != order || part->LDIR_Chksum != checksum) break;
+
+        memcpy(units, part->LDIR_Name1, sizeof(part->LDIR_Name1));
+        memcpy(units + 5, part->LDIR_Name2, sizeof(part->LDIR_Name2));
+        memcpy(units + 11, part->LDIR_Name3, sizeof(part->LDIR_Name3));
+
+        // UCS-2 to UTF-8, names end at a 0x0000 unit or run to the end of the last part
+        for (int i = 0; i < 13 && units[i] != 0x0000 && units[i] != 0xFFFF; i++) {
+
+            if (length + 3 > MAX_NAME_LENGTH) {
+                long_name[0] = '\0';
+                return;
+            }
+
+            if (units[i] < 0x80) {
+                long_name[length++] = units[i];
+            }
+            else if (units[i] < 0x800) {
+                long_name[length++] = 0xC0 | (units[i] >> 6);
+                long_name[length++] = 0x80 | (units[i] & 0x3F);
+            }
+            else {
+                long_name[length++] = 0xE0 | (units[i] >> 12);
+                long_name[length++] = 0x80 | ((units[i] >> 6) & 0x3F);
+                long_name[length++] = 0x80 | (units[i] & 0x3F);
+            }
+        }
+
+        if (part->LDIR_Ord & 0x40) {
+            long_name[length] = '\0';
+            return;
+        }
+    }
+
+    // Orphaned or damaged parts leave the entry with its short name only
+    long_name[0] = '\0';
+}
+
+static int probe(uint8_t *buffer, size_t length) {
+
+    BootSector *bs;
+    int cluster_count;
+
+    if (length < BOOT_SECTOR_SIZE) return 0;
+
+    bs = (BootSector*) buffer;
+
+    // Anything else would only divide by zero
+    if (bs->BPB_BytsPerSec == 0 || bs->BPB_SecPerClus == 0) return 0;
+
+    cluster_count = getClusterCount(*bs);
+
+    return (cluster_count >= 4085 && cluster_count < 65525);
+}
+
+static void* mountFilesystem(int fd) {
+
+    FATMount *mount;
+    uint16_t *fat;
+
+    mount = calloc(1, sizeof(FATMount));
+
+    ARENA_init(&mount->arena);
+    ARENA_init(&mount->dir_cache);
+    ARENA_init(&mount->file_cache);
+
+    mount->fd = fd;
+    mount->bs = getBootSector(fd);
+
+    // Everything a mount keeps lives in its arenas, so unmounting is a handful of frees whatever was read
+    fat = getFAT(fd, mount->bs);
+    mount->fat = ARENA_copy(&mount->arena, fat, mount->bs.BPB_FATSz16 * mount->bs.BPB_BytsPerSec);
+    free(fat);
+
+    if (mount->fat == NULL) {
+        unmountFilesystem(mount);
+        return NULL;
+    }
+
+    return mount;
+}
+
+static int statEntry(void *mount, uint64_t id, BackendStat *stat) {
+
+    FATDirectoryEntry entry;
+
+    // Root directory has no entry describing it
+    if (id == 0) {
+        stat->is_dir = 1;
+        stat->size = 0;
+        stat->mtime = 0;
+        return 0;
+    }
+
+    if (readEntry(mount, id, &entry) < 0) return -1;
+
+    stat->is_dir = (entry.DIR_Attr & 0x30) == 0x10;
+    stat->size = entry.DIR_FileSize;
+    stat->mtime = getModificationTime(&entry);
+
+    return 0;
+}
+
+static int readDirectory(void *mount, uint64_t dir_id, uint64_t *cookie, BackendEntry *entry) {
+
+    FATMount *fat = mount;
+    FATDirectoryEntry dir_entry, *entries;
+    uint32_t chain_length = 0;
+    uint16_t *clusters = NULL;
+    int cluster_id = 0, cluster_count = 0;
+    char name[13];
+
+    // Last directory read is kept whole, entry ids are their offsets in the image
+    if (!fat->dir_loaded || fat->dir_id != dir_id) {
+
+        if (dir_id != 0) {
+            if (readEntry(fat, dir_id, &dir_entry) < 0 || (dir_entry.DIR_Attr & 0x30) != 0x10) return -1;
+            if ((cluster_id = dir_entry.DIR_FstClusLO) == 0) return (*cookie == 0) ? 0 : -1;
+        }
+
+        entries = getDirectory(fat->fd, cluster_id, fat->fat, fat->bs, &fat->dir_total);
+
+        if (cluster_id != 0) clusters = malloc(sizeof(uint16_t) * (getChainLength(fat->fat, cluster_id, fat->bs)));
+
+        while (cluster_id != 0 && !isEndOfChain(cluster_id, fat->bs) && chain_length++ <= (uint32_t) getClusterCount(fat->bs)) {
+            clusters[cluster_count++] = cluster_id;
+            cluster_id = fat->fat[cluster_id];
+        }
+
+        // Entries and the chain they came from are one copy in the cache, so they are dropped together
+        fat->dir_loaded = 0;
+        fat->dir_cluster_count = cluster_count;
+        fat->dir_entries = allocateCache(fat, &fat->dir_cache, sizeof(FATDirectoryEntry) * fat->dir_total + sizeof(uint16_t) * cluster_count);
+
+        if (fat->dir_entries != NULL) {
+            memcpy(fat->dir_entries, entries, sizeof(FATDirectoryEntry) * fat->dir_total);
+            fat->dir_clusters = (uint16_t*) (fat->dir_entries + fat->dir_total);
+            memcpy(fat->dir_clusters, clusters, sizeof(uint16_t) * cluster_count);
+        }
+
+        free(entries);
+        free(clusters);
+
+        if (fat->dir_entries == NULL) return -1;
+
+        fat->dir_id = dir_id;
+        fat->dir_loaded = 1;
+    }
+
+    // Cookies are entry indexes, one past the last entry is where a listing ends
+    if (*cookie > (uint64_t) fat->dir_total) return -1;
+
+    while (*cookie < (uint64_t) fat->dir_total) {
+
+        dir_entry = fat->dir_entries[(*cookie)++];
+
+        if (dir_entry.DIR_Name[0] == 0xE5) continue;
+        if (dir_entry.DIR_Name[0] == 0x05) dir_entry.DIR_Name[0] = 0xE5;
+
+        cleanName(&name, dir_entry.DIR_Name);
+
+        if (isInternalFile(name, dir_entry.DIR_Attr)) continue;
+
+        entry->id = getEntryOffset(fat, *cookie - 1);
+        entry->is_dir = (dir_entry.DIR_Attr & 0x30) == 0x10;
+        strcpy(entry->name, name);
+        getLongName(fat->dir_entries, *cookie - 1, entry->long_name);
+
+        // Same values statEntry would read back from the image
+        entry->has_stat = 1;
+        entry->stat.is_dir = entry->is_dir;
+        entry->stat.size = dir_entry.DIR_FileSize;
+        entry->stat.mtime = getModificationTime(&dir_entry);
+
+        return 1;
+    }
+
+    return 0;
+}
+
+static int64_t readFile(void *mount, uint64_t id, uint64_t offset, void *buffer, uint64_t length) {
+
+    FATMount *fat = mount;
+    FATDirectoryEntry entry;
+    FileEntry file;
+
+    // Extents of the last file read are kept, so sequential reads follow its chain only once
+    if (!fat->file_loaded || fat->file_id != id) {
+
+        if (id == 0 || readEntry(fat, id, &entry) < 0 || (entry.DIR_Attr & 0x30) == 0x10) return -1;
+
+        memset(&file, 0, sizeof(FileEntry));
+
+        file.size = entry.DIR_FileSize;
+        mapChain(fat->bs, fat->fat, &entry, &file);
+
+        fat->file_loaded = 0;
+        fat->file = file;
+        fat->file.extents = allocateCache(fat, &fat->file_cache, sizeof(FileExtent) * file.extent_count);
+
+        if (fat->file.extents != NULL) memcpy(fat->file.extents, file.extents, sizeof(FileExtent) * file.extent_count);
+        free(file.extents);
+
+        if (fat->file.extents == NULL) return -1;
+
+        fat->file_id = id;
+        fat->file_loaded = 1;
+    }
+
+    return FILELIST_read(fat->fd, &fat->file, offset, buffer, length);
+}
+
+static void unmountFilesystem(void *mount) {
+
+    FATMount *fat = mount;
+
+    ARENA_free(&fat->arena);
+    ARENA_free(&fat->dir_cache);
+    ARENA_free(&fat->file_cache);
+    free(fat);
+}
+
+static void* allocateCache(FATMount *mount, Arena *cache, size_t size) {
+
+    void *data;
+
+    ARENA_reset(cache);
+
+    // At the memory limit the other cache is dropped to make room, it can always be read again
+    if ((data = ARENA_alloc(cache, size)) == NULL) {
+
+        if (cache == &mount->dir_cache) {
+            ARENA_free(&mount->file_cache);
+            mount->file_loaded = 0;
+        }
+        else {
+            ARENA_free(&mount->dir_cache);
+            mount->dir_loaded = 0;
+        }
+
+        data = ARENA_alloc(cache, size);
+    }
+
+    return data;
+}
+
+Backend FAT16_backend = {
+    "FAT16", 0, 1,
+    probe, mountFilesystem, statEntry, readDirectory, readFile, unmountFilesystem,
+    FAT16_showInfo, FAT16_getInfo, FAT16_showDeepInfo, FAT16_showTree, FAT16_showFile, NULL,
+    FAT16_showUsage, FAT16_checkConsistency, FAT16_listFiles, FAT16_watch
+};
\ No newline at end of file
@@ -7,17 +7,29 @@
 #include <unistd.h>
 #include <stdlib.h>
 #include <stdint.h>
+#include <time.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "../io/image.h"
+#include "../find/find.h"
+#include "../du/du.h"
+#include "../parallel/parallel.h"
+#include "../check/check.h"
+#include "../list/filelist.h"
+#include "../fleet/fleet.h"
+#include "../hash/hash.h"
+#include "../watch/watch.h"
+#include "../backend/backend.h"
+#include "../tree/tree.h"
+#include "../mem/arena.h"
 
 #define BOOT_SECTOR_SIZE 64
 #define DIRECTORY_ENTRY_SIZE 32
 
 #pragma pack(1)
 
-typedef struct {
-    int count;
-    int* is_last;
-} FATNest;
-
 typedef struct {
     uint8_t BS_jmpBoot[3];
     uint8_t BS_OEMName[8];
@@ -56,11 +68,104 @@ typedef struct {
     uint32_t DIR_FileSize;
 } FATDirectoryEntry;
 
+typedef struct {
+    uint8_t LDIR_Ord;
+    uint16_t LDIR_Name1[5];
+    uint8_t LDIR_Attr;
+    uint8_t LDIR_Type;
+    uint8_t LDIR_Chksum;
+    uint16_t LDIR_Name2[6];
+    uint16_t LDIR_FstClusLO;
+    uint16_t LDIR_Name3[2];
+} FATLongNameEntry;
+
 #pragma pack()
 
-int FAT16_check(int fd);
+typedef struct {
+    BootSector bs;
+    uint16_t* fat;
+    int count;
+    int capacity;
+    DUEntry* stack;
+    DUReport* report;
+} FATUsageScan;
+
+typedef struct {
+    uint32_t free_clusters;
+    uint32_t bad_clusters;
+    uint32_t end_of_chain;
+} FATEntryCounts;
+
+typedef struct {
+    BootSector bs;
+    uint16_t* fat;
+    uint8_t* reachable;
+    uint32_t chains;
+    uint32_t chained_clusters;
+    uint32_t fragmented_chains;
+    uint32_t longest_chain;
+} FATAnalysis;
+
+typedef struct {
+    BootSector bs;
+    uint16_t* fat;
+    uint8_t* chain_refs;
+    uint8_t* entry_refs;
+    CheckLog* logs;
+} FATCheckScan;
+
+typedef struct {
+    BootSector bs;
+    uint16_t* fat;
+    FileList* list;
+} FATListScan;
+
+typedef struct {
+    uint64_t dir_id;
+    uint16_t cluster;
+    uint64_t hash;
+} FATWatchCluster;
+
+typedef struct {
+    int fd;
+    BootSector bs;
+    uint16_t* fat;
+    uint64_t* sector_hashes;
+    int cluster_count;
+    int cluster_capacity;
+    FATWatchCluster* clusters;
+    struct timespec write_time;
+    WatchTree tree;
+} FATWatch;
+
+typedef struct {
+    int fd;
+    BootSector bs;
+    uint16_t* fat;
+    int dir_loaded;
+    uint64_t dir_id;
+    FATDirectoryEntry* dir_entries;
+    int dir_total;
+    int dir_cluster_count;
+    uint16_t* dir_clusters;
+    int file_loaded;
+    uint64_t file_id;
+    FileEntry file;
+    Arena arena;
+    Arena dir_cache;
+    Arena file_cache;
+} FATMount;
+
+extern Backend FAT16_backend;
+
 void FAT16_showInfo(int fd);
+void FAT16_getInfo(int fd, FleetInfo *info);
+void FAT16_showDeepInfo(int fd);
 void FAT16_showTree(int fd);
 int FAT16_showFile(int fd, char *file_path);
+void FAT16_showUsage(int fd, int top);
+int FAT16_checkConsistency(int fd);
+void FAT16_listFiles(int fd, FileList *list);
+void FAT16_watch(int fd, int interval);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,160 @@
+#include "find.h"
+
+static int getComparison(char **value);
+static int parseSize(char *value, uint64_t *size);
+static int parseTime(char *value, time_t *time, time_t *span);
+
+int FIND_parseArgs(FindQuery *query, int argc, char **argv) {
+
+    query->name = NULL;
+    query->type = FIND_ANY;
+    query->size_cmp = FIND_ANY;
+    query->size = 0;
+    query->mtime_cmp = FIND_ANY;
+    query->mtime = 0;
+    query->mtime_span = 1;
+
+    for (int i = 0; i < argc; i += 2) {
+
+        if (i + 1 >= argc) return -1;
+
+        if (strcmp(argv[i], "--name") == 0) {
+            query->name = argv[i + 1];
+        }
+        else if (strcmp(argv[i], "--type") == 0) {
+
+            if (strcmp(argv[i + 1], "f") != 0 && strcmp(argv[i + 1], "d") != 0) return -1;
+            query->type = argv[i + 1][0];
+        }
+        else if (strcmp(argv[i], "--size") == 0) {
+
+            char *value = argv[i + 1];
+
+            query->size_cmp = getComparison(&value);
+            if (parseSize(value, &query->size) < 0) return -1;
+        }
+        else if (strcmp(argv[i], "--mtime") == 0) {
+
+            char *value = argv[i + 1];
+
+            query->mtime_cmp = getComparison(&value);
+            if (parseTime(value, &query->mtime, &query->mtime_span) < 0) return -1;
+        }
+        else {
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+int FIND_matchesMetadata(FindQuery *query, uint64_t size, time_t mtime, int is_dir) {
+
+    if (query->type == 'f' && is_dir) return 0;
+    if (query->type == 'd' && !is_dir) return 0;
+
+    switch (query->size_cmp) {
+        case FIND_LESS:
+            if (size >= query->size) return 0;
+            break;
+        case FIND_EQUAL:
+            if (size != query->size) return 0;
+            break;
+        case FIND_GREATER:
+            if (size <= query->size) return 0;
+            break;
+    }
+
+    switch (query->mtime_cmp) {
+        case FIND_LESS:
+            if (mtime >= query->mtime) return 0;
+            break;
+        case FIND_EQUAL:
+            // Dates match the whole day they name, epoch values the exact second
+            if (mtime < query->mtime || mtime >= query->mtime + query->mtime_span) return 0;
+            break;
+        case FIND_GREATER:
+            // Newer than a date means after the last second of that day
+            if (mtime <= query->mtime + query->mtime_span - 1) return 0;
+            break;
+    }
+
+    return 1;
+}
+
+int FIND_matchesName(FindQuery *query, char *name) {
+    return query->name == NULL || fnmatch(query->name, name, 0) == 0;
+}
+
+static int getComparison(char **value) {
+
+    if (**value == '+') {
+        (*value)++;
+        return FIND_GREATER;
+    }
+
+    if (**value == '-') {
+        (*value)++;
+        return FIND_LESS;
+    }
+
+    return FIND_EQUAL;
+}
+
+static int parseSize(char *value, uint64_t *size) {
+
+    char *end;
+
+    *size = strtoull(value, &end, 10);
+
+    if (end == value) return -1;
+
+    switch (*end) {
+        case '\0':
+            return 0;
+        case 'k':
+        case 'K':
+            *size <<= 10;
+            break;
+        case 'M':
+            *size <<= 20;
+            break;
+        case 'G':
+            *size <<= 30;
+            break;
+        default:
+            return -1;
+    }
+
+    return end[1] == '\0' ? 0 : -1;
+}
+
+static int parseTime(char *value, time_t *time, time_t *span) {
+
+    struct tm date;
+    char *end;
+    int year, month, day, length = 0;
+
+    memset(&date, 0, sizeof(struct tm));
+
+    // Either a calendar date (local midnight) or seconds since the epoch
+    if (sscanf(value, "%d-%d-%d%n", &year, &month, &day, &length) == 3) {
+
+        if (value[length] != '\0' || month < 1 || month > 12 || day < 1) return -1;
+
+        date.tm_year = year - 1900;
+        date.tm_mon = month - 1;
+        date.tm_mday = day;
+        date.tm_isdst = -1;
+        *time = mktime(&date);
+        *span = 86400;
+
+        // mktime rolls days past the end of the month over, which is how they are caught
+        return (*time == -1 || date.tm_mon != month - 1 || date.tm_mday != day) ? -1 : 0;
+    }
+
+    *time = strtoll(value, &end, 10);
+    *span = 1;
+
+    return (end == value || *end != '\0') ? -1 : 0;
+}
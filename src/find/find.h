@@ -0,0 +1,30 @@
+#ifndef _FIND_H_
+#define _FIND_H_
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <time.h>
+#include <fnmatch.h>
+
+#define FIND_ANY 0
+#define FIND_LESS -1
+#define FIND_EQUAL 1
+#define FIND_GREATER 2
+
+typedef struct {
+    char* name;
+    char type;
+    int size_cmp;
+    uint64_t size;
+    int mtime_cmp;
+    time_t mtime;
+    time_t mtime_span;
+} FindQuery;
+
+int FIND_parseArgs(FindQuery *query, int argc, char **argv);
+int FIND_matchesMetadata(FindQuery *query, uint64_t size, time_t mtime, int is_dir);
+int FIND_matchesName(FindQuery *query, char *name);
+
+#endif
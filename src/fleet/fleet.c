@@ -0,0 +1,241 @@
+#include "fleet.h"
+
+static void scanImage(int worker, int index, void *ctx);
+static void reserve(FleetOutput *output, size_t length);
+static void append(FleetOutput *output, char *data, size_t length);
+static void emit(FleetOutput *output, const char *format, ...);
+static void emitString(FleetOutput *output, char *value);
+static void emitInfo(FleetOutput *output, char *image, FleetInfo *info);
+static void emitEntry(FleetOutput *output, char *image, FileEntry *entry);
+static void flush(FleetScan *scan, FleetOutput *output, size_t threshold);
+
+void FLEET_addImage(FleetImages *images, char *path) {
+
+    if (images->count == images->capacity) {
+        images->capacity = (images->capacity == 0) ? 64 : images->capacity * 2;
+        images->paths = realloc(images->paths, sizeof(char*) * images->capacity);
+    }
+
+    images->paths[images->count++] = strdup(path);
+}
+
+int FLEET_readImageList(FleetImages *images, char *list_path) {
+
+    FILE *list;
+    char *line = NULL;
+    size_t line_capacity = 0;
+    ssize_t length;
+
+    // One image path per line, "-" reads them from stdin
+    list = (strcmp(list_path, "-") == 0) ? stdin : fopen(list_path, "r");
+    if (list == NULL) return -1;
+
+    while ((length = getline(&line, &line_capacity, list)) >= 0) {
+
+        while (length > 0 && (line[length - 1] == '\n' || line[length - 1] == '\r')) line[--length] = '\0';
+        if (length > 0) FLEET_addImage(images, line);
+    }
+
+    free(line);
+    if (list != stdin) fclose(list);
+
+    return 0;
+}
+
+int FLEET_scan(FleetImages *images, int mode, FindQuery *query, int (*inspect)(int fd, int mode, FleetInfo *info, FileList *list)) {
+
+    FleetScan scan;
+
+    scan.images = images;
+    scan.mode = mode;
+    scan.query = query;
+    scan.inspect = inspect;
+    scan.failed = 0;
+
+    pthread_mutex_init(&scan.lock, NULL);
+
+    // Every worker keeps a single image open at a time, so open fds are bounded by the thread count
+    PARALLEL_runQueue(images->count, PARALLEL_getThreadCount(images->count), scanImage, &scan);
+
+    pthread_mutex_destroy(&scan.lock);
+
+    return scan.failed;
+}
+
+void FLEET_free(FleetImages *images) {
+
+    for (int i = 0; i < images->count; i++) free(images->paths[i]);
+
+    free(images->paths);
+    images->paths = NULL;
+    images->count = 0;
+    images->capacity = 0;
+}
+
+static void scanImage(int worker, int index, void *ctx) {
+
+    FleetScan *scan = ctx;
+    FleetOutput output;
+    FleetInfo info;
+    FileList list;
+    FileEntry *entry;
+    char *image, *name;
+    int fd, status = 0;
+
+    (void) worker;
+
+    image = scan->images->paths[index];
+
+    memset(&output, 0, sizeof(FleetOutput));
+    memset(&info, 0, sizeof(FleetInfo));
+    memset(&list, 0, sizeof(FileList));
+
+    if ((fd = IMAGE_open(image)) >= 0) status = scan->inspect(fd, scan->mode, &info, &list);
+
+    // Images that can't be read still get a record, so every input shows up in the output
+    if (fd < 0 || status < 0) {
+
+        emit(&output, "{\"image\":");
+        emitString(&output, image);
+        emit(&output, ",\"error\":");
+        emitString(&output, (fd < 0) ? strerror(errno) : ((status == FLEET_LOOP) ? "Directory tree loops back on itself" : "Unknown filesystem"));
+        emit(&output, "}\n");
+    }
+    else if (scan->mode == FLEET_INFO) {
+        emitInfo(&output, image, &info);
+    }
+    else {
+
+        FILELIST_sort(&list);
+
+        for (int i = 0; i < list.count; i++) {
+
+            entry = &list.entries[i];
+
+            if (scan->mode == FLEET_FIND) {
+
+                name = strrchr(entry->path, '/');
+                name = (name == NULL) ? entry->path : name + 1;
+
+                if (!FIND_matchesMetadata(scan->query, entry->size, entry->mtime, entry->is_dir) || !FIND_matchesName(scan->query, name)) continue;
+            }
+
+            emitEntry(&output, image, entry);
+
+            // Big trees stream out in pieces instead of piling up in memory, always on a record boundary
+            flush(scan, &output, FLEET_FLUSH_SIZE);
+        }
+    }
+
+    pthread_mutex_lock(&scan->lock);
+    if (fd < 0 || status < 0) scan->failed++;
+    pthread_mutex_unlock(&scan->lock);
+
+    flush(scan, &output, 0);
+
+    FILELIST_free(&list);
+    free(output.data);
+    if (fd >= 0) IMAGE_close(fd);
+}
+
+static void reserve(FleetOutput *output, size_t length) {
+
+    if (output->length + length + 1 <= output->capacity) return;
+
+    output->capacity = (output->capacity == 0) ? 4096 : output->capacity * 2;
+    if (output->capacity < output->length + length + 1) output->capacity = output->length + length + 1;
+
+    output->data = realloc(output->data, output->capacity);
+}
+
+static void append(FleetOutput *output, char *data, size_t length) {
+
+    reserve(output, length);
+    memcpy(output->data + output->length, data, length);
+    output->length += length;
+}
+
+static void emit(FleetOutput *output, const char *format, ...) {
+
+    va_list args;
+    int length;
+
+    va_start(args, format);
+    length = vsnprintf(NULL, 0, format, args);
+    va_end(args);
+
+    reserve(output, length);
+
+    va_start(args, format);
+    vsnprintf(output->data + output->length, length + 1, format, args);
+    va_end(args);
+
+    output->length += length;
+}
+
+static void emitString(FleetOutput *output, char *value) {
+
+    char *start;
+    unsigned char c;
+
+    append(output, "\"", 1);
+
+    // Plain runs are copied as they are, only quotes, backslashes and control characters get escaped
+    for (start = value; ; value++) {
+
+        c = *value;
+        if (c != '\0' && c != '"' && c != '\\' && c >= 0x20) continue;
+
+        append(output, start, value - start);
+        if (c == '\0') break;
+
+        if (c == '"' || c == '\\') emit(output, "\\%c", c);
+        else emit(output, "\\u%04x", c);
+
+        start = value + 1;
+    }
+
+    append(output, "\"", 1);
+}
+
+static void emitInfo(FleetOutput *output, char *image, FleetInfo *info) {
+
+    emit(output, "{\"image\":");
+    emitString(output, image);
+    emit(output, ",\"filesystem\":");
+    emitString(output, info->filesystem);
+    emit(output, ",\"label\":");
+    emitString(output, info->label);
+    emit(output, ",\"block_size\":%u,\"total_blocks\":%llu,\"free_blocks\":%llu", info->block_size, (unsigned long long) info->total_blocks, (unsigned long long) info->free_blocks);
+
+    // FAT16 has neither inodes nor a last write time to report
+    if (info->total_inodes > 0) {
+        emit(output, ",\"total_inodes\":%llu,\"free_inodes\":%llu", (unsigned long long) info->total_inodes, (unsigned long long) info->free_inodes);
+    }
+
+    if (info->last_written > 0) emit(output, ",\"last_written\":%lld", (long long) info->last_written);
+
+    emit(output, "}\n");
+}
+
+static void emitEntry(FleetOutput *output, char *image, FileEntry *entry) {
+
+    emit(output, "{\"image\":");
+    emitString(output, image);
+    emit(output, ",\"path\":");
+    emitString(output, entry->path);
+    emit(output, ",\"type\":\"%c\",\"size\":%llu,\"mtime\":%lld}\n", entry->is_dir ? 'd' : 'f', (unsigned long long) entry->size, (long long) entry->mtime);
+}
+
+static void flush(FleetScan *scan, FleetOutput *output, size_t threshold) {
+
+    if (output->length == 0 || output->length < threshold) return;
+
+    // Records are written whole, so lines from different images never interleave
+    pthread_mutex_lock(&scan->lock);
+    fwrite(output->data, 1, output->length, stdout);
+    fflush(stdout);
+    pthread_mutex_unlock(&scan->lock);
+
+    output->length = 0;
+}
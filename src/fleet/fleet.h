@@ -0,0 +1,62 @@
+#ifndef _FLEET_H_
+#define _FLEET_H_
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdarg.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "../io/image.h"
+#include "../find/find.h"
+#include "../list/filelist.h"
+#include "../parallel/parallel.h"
+
+#define FLEET_INFO 0
+#define FLEET_TREE 1
+#define FLEET_FIND 2
+#define FLEET_LOOP -2
+
+#define FLEET_FLUSH_SIZE (64 << 10)
+
+typedef struct {
+    char filesystem[8];
+    char label[17];
+    uint32_t block_size;
+    uint64_t total_blocks;
+    uint64_t free_blocks;
+    uint64_t total_inodes;
+    uint64_t free_inodes;
+    time_t last_written;
+} FleetInfo;
+
+typedef struct {
+    int count;
+    int capacity;
+    char** paths;
+} FleetImages;
+
+typedef struct {
+    size_t length;
+    size_t capacity;
+    char* data;
+} FleetOutput;
+
+typedef struct {
+    FleetImages* images;
+    int mode;
+    FindQuery* query;
+    int (*inspect)(int fd, int mode, FleetInfo *info, FileList *list);
+    int failed;
+    pthread_mutex_t lock;
+} FleetScan;
+
+void FLEET_addImage(FleetImages *images, char *path);
+int FLEET_readImageList(FleetImages *images, char *list_path);
+int FLEET_scan(FleetImages *images, int mode, FindQuery *query, int (*inspect)(int fd, int mode, FleetInfo *info, FileList *list));
+void FLEET_free(FleetImages *images);
+
+#endif
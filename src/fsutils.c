@@ -4,9 +4,21 @@
 #include <unistd.h>
 #include <stdlib.h>
 #include <stdint.h>
+#include <errno.h>
 
-#include "ext/ext2.h"
-#include "fat/fat16.h"
+#include "io/image.h"
+#include "find/find.h"
+#include "du/du.h"
+#include "list/filelist.h"
+#include "diff/diff.h"
+#include "dupes/dupes.h"
+#include "fleet/fleet.h"
+#include "backend/backend.h"
+#include "mem/arena.h"
+#include "tree/tree.h"
+#include "dentry/dentry.h"
+
+#define CAT_BUFFER_SIZE (1 << 20)
 
 int areEqual(char* str1, char* str2) {
     return strcmp(str1, str2) == 0;
@@ -17,102 +29,384 @@ int getOption(char** argv, int argc) {
     if (argc < 3) return -1;
 
     if (areEqual(argv[1], "--info")) {
+        if (argc > 4 || (argc == 4 && !areEqual(argv[3], "--deep"))) return -1;
         return 0;
     }
     else if (areEqual(argv[1], "--tree")) {
+        if (argc % 2 == 0) return -1;
         return 1;
     }
     else if (areEqual(argv[1], "--cat")) {
         if (argc < 4) return -1;
         return 2;
     }
+    else if (areEqual(argv[1], "--find")) {
+        return 3;
+    }
+    else if (areEqual(argv[1], "--check")) {
+        if (argc != 3) return -1;
+        return 5;
+    }
+    else if (areEqual(argv[1], "--diff")) {
+        if (argc != 4) return -1;
+        return 6;
+    }
+    else if (areEqual(argv[1], "--dupes")) {
+        if (argc != 3) return -1;
+        return 7;
+    }
+    else if (areEqual(argv[1], "--fleet")) {
+        if (argc < 4 || (!areEqual(argv[2], "--info") && !areEqual(argv[2], "--tree") && !areEqual(argv[2], "--find"))) return -1;
+        return 8;
+    }
+    else if (areEqual(argv[1], "--watch")) {
+        if (argc != 3 && (argc != 5 || !areEqual(argv[3], "--interval") || atoi(argv[4]) <= 0)) return -1;
+        return 9;
+    }
+    else if (areEqual(argv[1], "--du")) {
+        if (argc != 3 && (argc != 5 || !areEqual(argv[3], "--top"))) return -1;
+        return 4;
+    }
     else {
         return -1;
     }
 }
 
+void printOpenError() {
+
+    if (errno == ENOTSUP) {
+        printf("ERROR: Compressed images require fsutils built with ZSTD=1.\n");
+    }
+    else if (errno == EINVAL) {
+        printf("ERROR: Compressed image has an invalid seek table.\n");
+    }
+    else {
+        printf("ERROR: Filesystem provided does not point to a file.\n");
+    }
+}
+
 void printInfoHeader(char* type) {
     printf("\n------ Filesystem Information ------\n");
     printf("\nFilesystem: %s\n", type);
 }
 
-void execInfo(int fd) {
+void printUnknownError() {
+    printf("ERROR: Unknown filesystem. Only EXT2 and FAT16 are compatible.\n");
+}
+
+void execInfo(Backend *backend, int fd, int deep) {
+
+    printInfoHeader(backend->name);
+    backend->showInfo(fd);
+    if (deep) backend->showDeepInfo(fd);
+}
+
+int catPath(DentryCache *cache, int fd, char *path) {
+
+    BackendStat stat;
+    uint64_t id, offset = 0;
+    int64_t bytes_read;
+    uint8_t *buffer;
+
+    if (DENTRY_resolve(cache, path, &id) < 0 || cache->backend->stat(cache->mount, id, &stat) < 0 || stat.is_dir) return -1;
+
+    buffer = malloc(CAT_BUFFER_SIZE);
 
-    if (EXT2_check(fd)) {
-        printInfoHeader("EXT2");
-        EXT2_showInfo(fd);
+    while ((bytes_read = cache->backend->read(cache->mount, id, offset, buffer, CAT_BUFFER_SIZE)) > 0) {
+        fwrite(buffer, 1, bytes_read, stdout);
+        offset += bytes_read;
     }
-    else if (FAT16_check(fd)) {
-        printInfoHeader("FAT16");
-        FAT16_showInfo(fd);
+
+    free(buffer);
+
+    // Whatever is left of the file in the page cache won't be read again
+    IMAGE_dropBehind(fd);
+
+    return 0;
+}
+
+void execCat(Backend *backend, int fd, int argc, char **argv) {
+
+    DentryCache cache;
+    void *mount = NULL;
+    int return_val;
+
+    for (int i = 0; i < argc; i++) {
+
+        // Paths are resolved through the backend, bare names keep searching the whole tree
+        if (strchr(argv[i], '/') == NULL) {
+            return_val = backend->showFile(fd, argv[i]);
+            IMAGE_dropBehind(fd);
+        }
+        else {
+
+            // All paths share one mount, so directories they have in common are read and hashed only once
+            if (mount == NULL) {
+
+                if ((mount = backend->mount(fd)) == NULL) {
+                    printf("ERROR: Memory limit reached.\n");
+                    return;
+                }
+
+                DENTRY_init(&cache, backend, mount);
+            }
+
+            return_val = catPath(&cache, fd, argv[i]);
+        }
+
+        if (return_val == -1) {
+            printf("ERROR: File not found.\n");
+        }
     }
-    else {
-        printf("ERROR: Unknown filesystem. Only EXT2 and FAT16 are compatible.\n");
+
+    if (mount != NULL) {
+        DENTRY_free(&cache);
+        backend->unmount(mount);
     }
 }
 
-void execTree(int fd) {
+void execTree(Backend *backend, int fd, int argc, char **argv) {
+
+    void *mount;
+    char *cursor = NULL;
+    int limit = 0;
+
+    // Without a page size or a cursor the whole tree is printed in one go
+    if (argc == 0) {
+        backend->showTree(fd);
+        return;
+    }
+
+    for (int i = 0; i < argc; i += 2) {
 
-    if (EXT2_check(fd)) {
-        EXT2_showTree(fd);
+        if (areEqual(argv[i], "--limit") && atoi(argv[i + 1]) > 0) {
+            limit = atoi(argv[i + 1]);
+        }
+        else if (areEqual(argv[i], "--cursor")) {
+            cursor = argv[i + 1];
+        }
+        else {
+            printf("ERROR: Invalid tree arguments.\n");
+            return;
+        }
     }
-    else if (FAT16_check(fd)) {
-        FAT16_showTree(fd);
+
+    if ((mount = backend->mount(fd)) == NULL) {
+        printf("ERROR: Memory limit reached.\n");
+        return;
     }
-    else {
-        printf("ERROR: Unknown filesystem. Only EXT2 and FAT16 are compatible.\n");
+
+    if (TREE_printPage(backend, mount, limit, cursor) < 0) {
+        printf("ERROR: Invalid cursor.\n");
     }
+
+    backend->unmount(mount);
 }
 
-void execCat(int fd, char *file_name) {
+void execFind(Backend *backend, int fd, int argc, char **argv) {
 
-    int return_val = 0;
+    FindQuery query;
+    int result;
 
-    if (EXT2_check(fd)) {
-        return_val = EXT2_showFile(fd, file_name);
+    if (FIND_parseArgs(&query, argc, argv) < 0) {
+        printf("ERROR: Invalid find predicates.\n");
+        return;
     }
-    else if (FAT16_check(fd)) {
-        return_val = FAT16_showFile(fd, file_name);
+
+    if ((result = BACKEND_find(backend, fd, &query)) == BACKEND_LOOP) {
+        printf("ERROR: Directory tree loops back on itself, the results are incomplete.\n");
     }
-    else {
-        printf("ERROR: Unknown filesystem. Only EXT2 and FAT16 are compatible.\n");
+    else if (result < 0) {
+        printf("ERROR: Memory limit reached.\n");
+    }
+}
+
+int execDiff(Backend *backend, int fd, char *other_filesystem) {
+
+    Backend *other_backend;
+    FileList list_a, list_b;
+    int other_fd, differences;
+
+    if ((other_fd = IMAGE_open(other_filesystem)) < 0) {
+        printOpenError();
+        return -1;
+    }
+
+    // Only the second image still needs probing, main already did the first
+    if ((other_backend = BACKEND_probe(other_fd)) == NULL) {
+        printUnknownError();
+        IMAGE_close(other_fd);
+        return -1;
+    }
+
+    memset(&list_a, 0, sizeof(FileList));
+    memset(&list_b, 0, sizeof(FileList));
+
+    backend->listFiles(fd, &list_a);
+    other_backend->listFiles(other_fd, &list_b);
+
+    differences = DIFF_compare(fd, &list_a, other_fd, &list_b);
+
+    FILELIST_free(&list_a);
+    FILELIST_free(&list_b);
+    IMAGE_close(other_fd);
+
+    return differences;
+}
+
+void execDupes(Backend *backend, int fd) {
+
+    FileList list;
+
+    memset(&list, 0, sizeof(FileList));
+
+    backend->listFiles(fd, &list);
+    DUPES_find(fd, &list);
+
+    FILELIST_free(&list);
+}
+
+void addListEntry(char *path, char *name, BackendStat *stat, void *ctx) {
+
+    (void) name;
+
+    FILELIST_add(ctx, strdup(path), stat->size, stat->mtime, stat->is_dir);
+}
+
+int inspectImage(int fd, int mode, FleetInfo *info, FileList *list) {
+
+    Backend *backend;
+    void *mount;
+    int status;
+
+    if ((backend = BACKEND_probe(fd)) == NULL) return -1;
+
+    if (mode == FLEET_INFO) {
+        backend->getInfo(fd, info);
+        return 0;
+    }
+
+    // Listings and predicates only need metadata, so no file has its extents mapped
+    if ((mount = backend->mount(fd)) == NULL) return -1;
+
+    status = BACKEND_walk(backend, mount, backend->root_id, "", addListEntry, list);
+    backend->unmount(mount);
+
+    return (status == BACKEND_LOOP) ? FLEET_LOOP : 0;
+}
+
+int execFleet(int argc, char **argv) {
+
+    FleetImages images;
+    FindQuery query;
+    int mode, failed = -1, i = 1;
+
+    mode = areEqual(argv[0], "--info") ? FLEET_INFO : (areEqual(argv[0], "--tree") ? FLEET_TREE : FLEET_FIND);
+
+    memset(&images, 0, sizeof(FleetImages));
+
+    // Images come first, either as paths or as lists of paths, and find predicates after them
+    for (; i < argc; i++) {
+
+        if (areEqual(argv[i], "--images") && i + 1 < argc) {
+
+            if (FLEET_readImageList(&images, argv[++i]) < 0) {
+                printf("ERROR: Image list %s could not be read.\n", argv[i]);
+                FLEET_free(&images);
+                return -1;
+            }
+        }
+        else if (strncmp(argv[i], "--", 2) == 0) {
+            break;
+        }
+        else {
+            FLEET_addImage(&images, argv[i]);
+        }
     }
 
-    if (return_val == -1) {
-        printf("ERROR: File not found.\n");
+    if ((mode != FLEET_FIND && i < argc) || FIND_parseArgs(&query, argc - i, argv + i) < 0) {
+        printf("ERROR: Invalid fleet arguments.\n");
     }
+    else {
+        failed = FLEET_scan(&images, mode, &query, inspectImage);
+    }
+
+    FLEET_free(&images);
+
+    return failed;
 }
 
 int main(int argc, char* argv[]) {
 
+    Backend *backend = NULL;
+    size_t memory_limit;
     int option;
     int filesystem_fd = 0;
+    int exit_code = 0;
+
+    // The memory limit applies to any command, so it is taken off the end of the arguments first
+    if (argc >= 5 && areEqual(argv[argc - 2], "--memory")) {
+
+        argc -= 2;
+
+        if (ARENA_parseSize(argv[argc + 1], &memory_limit) < 0) argc = 0;
+        else ARENA_setLimit(memory_limit);
+    }
 
     option = getOption(argv, argc);
 
-    if (option >= 0) {
-        if ((filesystem_fd =  open(argv[2], O_RDONLY)) < 0) {
-            printf("ERROR: Filesystem provided does not point to a file.\n");
+    // Fleet scans open each of their images on their own
+    if (option >= 0 && option != 8) {
+        if ((filesystem_fd = IMAGE_open(argv[2])) < 0) {
+            printOpenError();
+            option = -2;
+        }
+        else if ((backend = BACKEND_probe(filesystem_fd)) == NULL) {
+            printUnknownError();
+            // Still a failure for the commands reporting through the exit code
+            exit_code = (option == 5 || option == 6);
             option = -2;
         }
     }
 
     switch (option) {
         case 0:
-            execInfo(filesystem_fd);
+            execInfo(backend, filesystem_fd, argc == 4);
             break;
         case 1:
-            execTree(filesystem_fd);
+            execTree(backend, filesystem_fd, argc - 3, argv + 3);
             break;
         case 2:
-            execCat(filesystem_fd, argv[3]);
+            execCat(backend, filesystem_fd, argc - 3, argv + 3);
+            break;
+        case 3:
+            execFind(backend, filesystem_fd, argc - 3, argv + 3);
+            break;
+        case 4:
+            backend->showUsage(filesystem_fd, (argc == 5) ? atoi(argv[4]) : 0);
+            break;
+        case 5:
+            // Problems found are reported through the exit code, for use in pipelines
+            exit_code = (backend->checkConsistency(filesystem_fd) != 0);
+            break;
+        case 6:
+            exit_code = (execDiff(backend, filesystem_fd, argv[3]) != 0);
+            break;
+        case 7:
+            execDupes(backend, filesystem_fd);
+            break;
+        case 8:
+            exit_code = (execFleet(argc - 2, argv + 2) != 0);
+            break;
+        case 9:
+            backend->watch(filesystem_fd, (argc == 5) ? atoi(argv[4]) : 2);
             break;
         case -1:
-            printf("Usage:\n\t./fsutils --info <filesystem>\n\t./fsutils --tree <filesystem>\n\t./fsutils --cat <filesystem> <filename>\n");
+            printf("Usage:\n\t./fsutils --info <filesystem> [--deep]\n\t./fsutils --tree <filesystem> [--limit <n>] [--cursor <token>]\n\t./fsutils --cat <filesystem> <filename|/path>...\n\t./fsutils --find <filesystem> [--name <glob>] [--type f|d] [--size [+-]<n>[kMG]] [--mtime [+-]<YYYY-MM-DD|epoch>]\n\t./fsutils --du <filesystem> [--top <n>]\n\t./fsutils --check <filesystem>\n\t./fsutils --diff <filesystem> <filesystem>\n\t./fsutils --dupes <filesystem>\n\t./fsutils --fleet --info|--tree|--find [<filesystem>...] [--images <list>] [find predicates]\n\t./fsutils --watch <filesystem> [--interval <seconds>]\n\nAny command can end with --memory <n>[kMG]. It caps the directory metadata and caches of --tree and --cat,\nand the frames cached for compressed images. Other commands don't count their scans against it.\n");
             break;
     }
 
-    close(filesystem_fd);
+    IMAGE_close(filesystem_fd);
 
-    return 0;
+    return exit_code;
 }
\ No newline at end of file
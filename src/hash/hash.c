@@ -0,0 +1,57 @@
+#include "hash.h"
+
+#define HASH_PRIME_1 0x9E3779B185EBCA87ULL
+#define HASH_PRIME_2 0xC2B2AE3D27D4EB4FULL
+#define HASH_PRIME_3 0x165667B19E3779F9ULL
+
+static uint64_t mix(uint64_t hash, uint64_t value);
+
+uint64_t HASH_compute(const void *data, size_t length, uint64_t seed) {
+
+    const uint8_t *bytes = data;
+    uint64_t lanes[4], word, tail;
+    size_t i = 0;
+
+    lanes[0] = seed + HASH_PRIME_1 + HASH_PRIME_2;
+    lanes[1] = seed + HASH_PRIME_2;
+    lanes[2] = seed;
+    lanes[3] = seed - HASH_PRIME_1;
+
+    // Four independent lanes of 8 bytes each keep the multipliers busy in parallel
+    for (; i + 32 <= length; i += 32) {
+
+        for (int lane = 0; lane < 4; lane++) {
+            memcpy(&word, bytes + i + lane * 8, 8);
+            lanes[lane] = mix(lanes[lane], word);
+        }
+    }
+
+    word = ((lanes[0] << 1) | (lanes[0] >> 63)) + ((lanes[1] << 7) | (lanes[1] >> 57)) + ((lanes[2] << 12) | (lanes[2] >> 52)) + ((lanes[3] << 18) | (lanes[3] >> 46));
+    word += length;
+
+    for (; i + 8 <= length; i += 8) {
+        memcpy(&tail, bytes + i, 8);
+        word = mix(word, tail);
+    }
+
+    for (; i < length; i++) {
+        word = (word ^ (bytes[i] * HASH_PRIME_3)) * HASH_PRIME_1;
+    }
+
+    // Final avalanche so every input bit affects every output bit
+    word ^= word >> 33;
+    word *= HASH_PRIME_2;
+    word ^= word >> 29;
+    word *= HASH_PRIME_3;
+    word ^= word >> 32;
+
+    return word;
+}
+
+static uint64_t mix(uint64_t hash, uint64_t value) {
+
+    hash += value * HASH_PRIME_2;
+    hash = (hash << 31) | (hash >> 33);
+
+    return hash * HASH_PRIME_1;
+}
@@ -0,0 +1,10 @@
+#ifndef _HASH_H_
+#define _HASH_H_
+
+#include <string.h>
+#include <stdint.h>
+#include <stddef.h>
+
+uint64_t HASH_compute(const void *data, size_t length, uint64_t seed);
+
+#endif
@@ -0,0 +1,617 @@
+#include "image.h"
+
+static ImageState* images[MAX_IMAGE_FDS];
+static ImageStream* streams[MAX_IMAGE_FDS];
+
+static ImageState* getState(int fd);
+static ImageStream* getStream(int fd);
+static void trackRead(ImageStream *stream, off_t offset, ssize_t length);
+static int compareReads(const void *a, const void *b);
+static int getRunEnd(ImageRead *reads, int count, int first, off_t *run_end);
+#ifdef HAVE_ZSTD
+static ImageState* loadSeekTable(int fd, off_t file_size, uint8_t *footer);
+static int findFrame(ImageState *state, uint64_t offset);
+static ImageChunk* decompressFrame(ImageState *state, int frame);
+static void decompressMissing(int worker, int index, void *ctx);
+static void cacheChunk(ImageState *state, ImageChunk *chunk);
+static ssize_t readCompressed(ImageState *state, void *buffer, size_t length, off_t offset);
+#endif
+
+int IMAGE_open(const char *path) {
+
+    uint8_t footer[SEEK_TABLE_FOOTER_SIZE];
+    uint32_t magic;
+    off_t file_size;
+    int fd;
+
+    if ((fd = open(path, O_RDONLY)) < 0) return -1;
+
+    file_size = lseek(fd, 0, SEEK_END);
+    lseek(fd, 0, SEEK_SET);
+
+    // Seekable zstd images end with a seek table footer, anything else is read as a raw image
+    if (file_size < SEEK_TABLE_FOOTER_SIZE || pread(fd, footer, SEEK_TABLE_FOOTER_SIZE, file_size - SEEK_TABLE_FOOTER_SIZE) != SEEK_TABLE_FOOTER_SIZE) memset(footer, 0, SEEK_TABLE_FOOTER_SIZE);
+
+    memcpy(&magic, footer + 5, 4);
+
+    // Raw images are read straight from the page cache, so the kernel gets told how they are being read
+    if (magic != SEEKABLE_MAGIC) {
+
+        if (fd < MAX_IMAGE_FDS) {
+            streams[fd] = calloc(1, sizeof(ImageStream));
+            streams[fd]->fd = fd;
+            streams[fd]->window = READAHEAD_MIN;
+            pthread_mutex_init(&streams[fd]->lock, NULL);
+        }
+
+        return fd;
+    }
+
+#ifdef HAVE_ZSTD
+    if (fd >= MAX_IMAGE_FDS || (images[fd] = loadSeekTable(fd, file_size, footer)) == NULL) {
+        close(fd);
+        errno = EINVAL;
+        return -1;
+    }
+
+    return fd;
+#else
+    close(fd);
+    errno = ENOTSUP;
+    return -1;
+#endif
+}
+
+void IMAGE_close(int fd) {
+
+    ImageState *state;
+    ImageStream *stream;
+
+    state = getState(fd);
+    stream = getStream(fd);
+
+    if (stream != NULL) {
+        pthread_mutex_destroy(&stream->lock);
+        free(stream);
+        streams[fd] = NULL;
+    }
+
+    if (state != NULL) {
+
+        for (int i = 0; i < state->cached_count; i++) {
+            ARENA_release(state->cached[i]->size);
+            free(state->cached[i]->data);
+            free(state->cached[i]);
+        }
+
+        pthread_mutex_destroy(&state->lock);
+        free(state->compressed_offsets);
+        free(state->decompressed_offsets);
+        free(state->slots);
+        free(state->cached);
+        free(state);
+
+        images[fd] = NULL;
+    }
+
+    close(fd);
+}
+
+ssize_t IMAGE_pread(int fd, void *buffer, size_t length, off_t offset) {
+
+    ImageStream *stream;
+    ssize_t bytes_read;
+#ifdef HAVE_ZSTD
+    ImageState *state;
+
+    if ((state = getState(fd)) != NULL) return readCompressed(state, buffer, length, offset);
+#endif
+
+    bytes_read = pread(fd, buffer, length, offset);
+
+    // Workers sharing the fd interleave their reads, so they would only keep resetting the stream
+    if ((stream = getStream(fd)) != NULL && !PARALLEL_inWorker()) trackRead(stream, offset, bytes_read);
+
+    return bytes_read;
+}
+
+ssize_t IMAGE_read(int fd, void *buffer, size_t length) {
+
+    ImageState *state;
+    ImageStream *stream;
+    ssize_t bytes_read;
+
+    // Raw images keep track of their position, so sequential reads through read() are noticed too
+    if ((stream = getStream(fd)) != NULL) {
+
+        bytes_read = read(fd, buffer, length);
+        trackRead(stream, stream->position, bytes_read);
+        if (bytes_read > 0) stream->position += bytes_read;
+
+        return bytes_read;
+    }
+
+    if ((state = getState(fd)) == NULL) return read(fd, buffer, length);
+
+    bytes_read = IMAGE_pread(fd, buffer, length, state->position);
+    if (bytes_read > 0) state->position += bytes_read;
+
+    return bytes_read;
+}
+
+off_t IMAGE_lseek(int fd, off_t offset, int whence) {
+
+    ImageState *state;
+    ImageStream *stream;
+    off_t position;
+
+    if ((stream = getStream(fd)) != NULL) {
+
+        if ((position = lseek(fd, offset, whence)) >= 0) stream->position = position;
+
+        return position;
+    }
+
+    if ((state = getState(fd)) == NULL) return lseek(fd, offset, whence);
+
+    // Offsets on compressed images are positions in the decompressed image
+    switch (whence) {
+        case SEEK_SET:
+            position = offset;
+            break;
+        case SEEK_CUR:
+            position = state->position + offset;
+            break;
+        case SEEK_END:
+            position = state->size + offset;
+            break;
+        default:
+            errno = EINVAL;
+            return -1;
+    }
+
+    if (position < 0) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    state->position = position;
+
+    return position;
+}
+
+void IMAGE_willNeed(int fd, off_t offset, off_t length) {
+
+    // Compressed images decompress whole frames anyway
+    if (getStream(fd) != NULL && length > 0) posix_fadvise(fd, offset, length, POSIX_FADV_WILLNEED);
+}
+
+void IMAGE_dontNeed(int fd, off_t offset, off_t length) {
+    if (getStream(fd) != NULL && length > 0) posix_fadvise(fd, offset, length, POSIX_FADV_DONTNEED);
+}
+
+void IMAGE_dropBehind(int fd) {
+
+    ImageStream *stream;
+    off_t end;
+
+    if ((stream = getStream(fd)) == NULL) return;
+
+    pthread_mutex_lock(&stream->lock);
+
+    // A finished extraction won't be read again, including whatever readahead was asked for past its end
+    if (stream->sequential) {
+
+        end = (stream->advised_end > stream->last_end) ? stream->advised_end : stream->last_end;
+        IMAGE_dontNeed(fd, stream->dropped_end, end - stream->dropped_end);
+
+        posix_fadvise(fd, 0, 0, POSIX_FADV_NORMAL);
+        stream->sequential_reads = 0;
+        stream->sequential = 0;
+        stream->window = READAHEAD_MIN;
+        stream->advised_end = 0;
+        stream->dropped_end = end;
+    }
+
+    pthread_mutex_unlock(&stream->lock);
+}
+
+int IMAGE_getWriteTime(int fd, struct timespec *write_time) {
+
+    struct stat st;
+
+    // Block devices don't move their times when written through, only image files can tell
+    if (fstat(fd, &st) < 0 || !S_ISREG(st.st_mode)) return -1;
+
+    *write_time = st.st_mtim;
+
+    return 0;
+}
+
+int IMAGE_readBatch(int fd, ImageRead *reads, int count) {
+
+    uint8_t *run = NULL;
+    size_t run_capacity = 0, run_length;
+    off_t run_end;
+    ssize_t bytes_read;
+    int first, last, result = 0;
+
+    // One ascending sweep over the image instead of seeking back and forth in the order reads were asked for
+    qsort(reads, count, sizeof(ImageRead), compareReads);
+
+    // Every run is announced before the first one is read, so the device can queue the whole sweep
+    for (first = 0; first < count; first = last) {
+        last = getRunEnd(reads, count, first, &run_end);
+        IMAGE_willNeed(fd, reads[first].offset, run_end - reads[first].offset);
+    }
+
+    for (first = 0; first < count; first = last) {
+
+        last = getRunEnd(reads, count, first, &run_end);
+        run_length = run_end - reads[first].offset;
+
+        if (run_length > run_capacity) {
+            run_capacity = run_length;
+            run = realloc(run, run_capacity);
+        }
+
+        // Past the end of the image reads as zeros, like the holes of a sparse file
+        if ((bytes_read = IMAGE_pread(fd, run, run_length, reads[first].offset)) < 0) {
+            result = -1;
+            bytes_read = 0;
+        }
+        memset(run + bytes_read, 0, run_length - bytes_read);
+
+        for (int i = first; i < last; i++) {
+            memcpy(reads[i].buffer, run + (reads[i].offset - reads[first].offset), reads[i].length);
+        }
+    }
+
+    free(run);
+
+    return result;
+}
+
+static ImageState* getState(int fd) {
+    return (fd >= 0 && fd < MAX_IMAGE_FDS) ? images[fd] : NULL;
+}
+
+static ImageStream* getStream(int fd) {
+    return (fd >= 0 && fd < MAX_IMAGE_FDS) ? streams[fd] : NULL;
+}
+
+static int compareReads(const void *a, const void *b) {
+
+    off_t offset_a = ((const ImageRead*) a)->offset, offset_b = ((const ImageRead*) b)->offset;
+
+    return (offset_a > offset_b) - (offset_a < offset_b);
+}
+
+static int getRunEnd(ImageRead *reads, int count, int first, off_t *run_end) {
+
+    off_t end;
+    int i;
+
+    *run_end = reads[first].offset + reads[first].length;
+
+    // Small holes between reads are read through, it is cheaper than another request
+    for (i = first + 1; i < count && reads[i].offset <= *run_end + BATCH_GAP; i++) {
+
+        end = reads[i].offset + reads[i].length;
+        if (end < *run_end) end = *run_end;
+
+        if (end - reads[first].offset > BATCH_RUN_SIZE) break;
+
+        *run_end = end;
+    }
+
+    return i;
+}
+
+static void trackRead(ImageStream *stream, off_t offset, ssize_t length) {
+
+    off_t start;
+
+    if (length <= 0) return;
+
+    pthread_mutex_lock(&stream->lock);
+
+    // Small forward skips, like the gaps between a file's extents, still count as sequential
+    if (offset >= stream->last_end && offset - stream->last_end <= SEQUENTIAL_GAP) {
+        stream->sequential_reads++;
+    }
+    else {
+
+        if (stream->sequential) posix_fadvise(stream->fd, 0, 0, POSIX_FADV_NORMAL);
+
+        stream->sequential_reads = 0;
+        stream->sequential = 0;
+        stream->window = READAHEAD_MIN;
+        stream->advised_end = 0;
+        stream->dropped_end = offset;
+    }
+
+    stream->last_end = offset + length;
+
+    if (stream->sequential_reads >= SEQUENTIAL_READS) {
+
+        if (!stream->sequential) {
+            posix_fadvise(stream->fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+            stream->sequential = 1;
+        }
+
+        // Asked again once reads get within half a window of what was already asked for, each time for twice as much
+        if (stream->last_end + stream->window / 2 >= stream->advised_end) {
+
+            start = (stream->advised_end > stream->last_end) ? stream->advised_end : stream->last_end;
+            posix_fadvise(stream->fd, start, stream->last_end + stream->window - start, POSIX_FADV_WILLNEED);
+
+            stream->advised_end = stream->last_end + stream->window;
+            if (stream->window < READAHEAD_MAX) stream->window *= 2;
+        }
+
+        // Long extractions drop what they already read, instead of pushing everything else out of the page cache
+        if (offset - stream->dropped_end >= DROP_BEHIND_SIZE) {
+            posix_fadvise(stream->fd, stream->dropped_end, offset - stream->dropped_end, POSIX_FADV_DONTNEED);
+            stream->dropped_end = offset;
+        }
+    }
+
+    pthread_mutex_unlock(&stream->lock);
+}
+
+#ifdef HAVE_ZSTD
+static ImageState* loadSeekTable(int fd, off_t file_size, uint8_t *footer) {
+
+    ImageState *state;
+    uint8_t *table;
+    uint32_t frame_count, magic, compressed_size, decompressed_size;
+    off_t table_offset;
+    int entry_size;
+
+    memcpy(&frame_count, footer, 4);
+
+    // Descriptor bit 7 adds a 4-byte checksum to every entry
+    entry_size = (footer[4] & 0x80) ? 12 : 8;
+    table_offset = file_size - SEEK_TABLE_FOOTER_SIZE - (off_t) frame_count * entry_size;
+
+    // Seek table is wrapped in a skippable frame whose 8-byte header comes right before it
+    if (frame_count == 0 || table_offset < 8) return NULL;
+    if (pread(fd, &magic, 4, table_offset - 8) != 4 || magic != SKIPPABLE_MAGIC) return NULL;
+
+    table = malloc((size_t) frame_count * entry_size);
+
+    if (pread(fd, table, (size_t) frame_count * entry_size, table_offset) != (ssize_t) frame_count * entry_size) {
+        free(table);
+        return NULL;
+    }
+
+    state = calloc(1, sizeof(ImageState));
+    state->fd = fd;
+    state->frame_count = frame_count;
+    state->compressed_offsets = malloc(sizeof(uint64_t) * (frame_count + 1));
+    state->decompressed_offsets = malloc(sizeof(uint64_t) * (frame_count + 1));
+    state->slots = calloc(frame_count, sizeof(ImageChunk*));
+    state->cached = malloc(sizeof(ImageChunk*) * frame_count);
+
+    state->compressed_offsets[0] = 0;
+    state->decompressed_offsets[0] = 0;
+
+    for (uint32_t i = 0; i < frame_count; i++) {
+
+        memcpy(&compressed_size, table + i * entry_size, 4);
+        memcpy(&decompressed_size, table + i * entry_size + 4, 4);
+
+        state->compressed_offsets[i + 1] = state->compressed_offsets[i] + compressed_size;
+        state->decompressed_offsets[i + 1] = state->decompressed_offsets[i] + decompressed_size;
+    }
+
+    state->size = state->decompressed_offsets[frame_count];
+
+    pthread_mutex_init(&state->lock, NULL);
+
+    free(table);
+
+    return state;
+}
+
+static int findFrame(ImageState *state, uint64_t offset) {
+
+    int low = 0, high = state->frame_count - 1, middle;
+
+    // Last frame starting at or before the offset
+    while (low < high) {
+
+        middle = (low + high + 1) / 2;
+
+        if (state->decompressed_offsets[middle] <= offset) low = middle;
+        else high = middle - 1;
+    }
+
+    return low;
+}
+
+static ImageChunk* decompressFrame(ImageState *state, int frame) {
+
+    ImageChunk *chunk;
+    uint8_t *compressed;
+    size_t compressed_size, result;
+
+    compressed_size = state->compressed_offsets[frame + 1] - state->compressed_offsets[frame];
+    compressed = malloc(compressed_size);
+
+    chunk = calloc(1, sizeof(ImageChunk));
+    chunk->frame = frame;
+    chunk->size = state->decompressed_offsets[frame + 1] - state->decompressed_offsets[frame];
+    chunk->data = malloc(chunk->size);
+    chunk->pins = 1;
+
+    if (pread(state->fd, compressed, compressed_size, state->compressed_offsets[frame]) != (ssize_t) compressed_size) {
+        result = 0;
+    }
+    else {
+        result = ZSTD_decompress(chunk->data, chunk->size, compressed, compressed_size);
+    }
+
+    free(compressed);
+
+    if (ZSTD_isError(result) || result != chunk->size) {
+        free(chunk->data);
+        free(chunk);
+        return NULL;
+    }
+
+    return chunk;
+}
+
+static void decompressMissing(int worker, int index, void *ctx) {
+
+    ImageDecompression *decompression = ctx;
+    int frame;
+
+    (void) worker;
+
+    frame = decompression->missing[index];
+    decompression->chunks[frame - decompression->first_frame] = decompressFrame(decompression->state, frame);
+}
+
+static void cacheChunk(ImageState *state, ImageChunk *chunk) {
+
+    ImageChunk *oldest;
+    int oldest_index;
+
+    // Another reader may have decompressed the same frame meanwhile
+    if (state->slots[chunk->frame] != NULL) return;
+
+    // Least recently used chunks nobody is reading from make room for the new one, also when the memory limit is reached
+    while (state->cached_bytes + chunk->size > IMAGE_CACHE_SIZE || ARENA_reserve(chunk->size) < 0) {
+
+        oldest_index = -1;
+
+        for (int i = 0; i < state->cached_count; i++) {
+
+            if (state->cached[i]->pins > 0) continue;
+            if (oldest_index < 0 || state->cached[i]->last_used < state->cached[oldest_index]->last_used) oldest_index = i;
+        }
+
+        if (oldest_index < 0) return;
+
+        oldest = state->cached[oldest_index];
+        state->cached[oldest_index] = state->cached[--state->cached_count];
+        state->slots[oldest->frame] = NULL;
+        state->cached_bytes -= oldest->size;
+
+        ARENA_release(oldest->size);
+        free(oldest->data);
+        free(oldest);
+    }
+
+    chunk->cached = 1;
+    chunk->last_used = ++state->tick;
+
+    state->slots[chunk->frame] = chunk;
+    state->cached[state->cached_count++] = chunk;
+    state->cached_bytes += chunk->size;
+}
+
+static ssize_t readCompressed(ImageState *state, void *buffer, size_t length, off_t offset) {
+
+    ImageDecompression decompression;
+    ImageChunk *chunk;
+    uint64_t start, end;
+    ssize_t bytes_read;
+    int total_frames, total_missing = 0;
+
+    if (offset < 0) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    if ((uint64_t) offset >= state->size || length == 0) return 0;
+    if ((uint64_t) offset + length > state->size) length = state->size - offset;
+
+    decompression.state = state;
+    decompression.first_frame = findFrame(state, offset);
+
+    total_frames = findFrame(state, offset + length - 1) - decompression.first_frame + 1;
+
+    decompression.chunks = calloc(total_frames, sizeof(ImageChunk*));
+    decompression.missing = malloc(sizeof(int) * total_frames);
+
+    // Cached chunks are pinned so they can't be evicted while being copied out
+    pthread_mutex_lock(&state->lock);
+
+    for (int i = 0; i < total_frames; i++) {
+
+        chunk = state->slots[decompression.first_frame + i];
+
+        if (chunk == NULL) {
+            decompression.missing[total_missing++] = decompression.first_frame + i;
+            continue;
+        }
+
+        chunk->pins++;
+        chunk->last_used = ++state->tick;
+        decompression.chunks[i] = chunk;
+    }
+
+    pthread_mutex_unlock(&state->lock);
+
+    // Large sequential reads touch many frames, which are decompressed in parallel unless workers already keep every core busy
+    if (total_missing > 1 && !PARALLEL_inWorker()) {
+        PARALLEL_runQueue(total_missing, PARALLEL_getThreadCount(total_missing), decompressMissing, &decompression);
+    }
+    else {
+        for (int i = 0; i < total_missing; i++) decompressMissing(0, i, &decompression);
+    }
+
+    pthread_mutex_lock(&state->lock);
+
+    for (int i = 0; i < total_missing; i++) {
+
+        chunk = decompression.chunks[decompression.missing[i] - decompression.first_frame];
+        if (chunk != NULL) cacheChunk(state, chunk);
+    }
+
+    pthread_mutex_unlock(&state->lock);
+
+    bytes_read = length;
+
+    for (int i = 0; i < total_frames; i++) {
+
+        chunk = decompression.chunks[i];
+
+        if (chunk == NULL) {
+            errno = EIO;
+            bytes_read = -1;
+            break;
+        }
+
+        start = (state->decompressed_offsets[chunk->frame] > (uint64_t) offset) ? state->decompressed_offsets[chunk->frame] : (uint64_t) offset;
+        end = (state->decompressed_offsets[chunk->frame + 1] < offset + length) ? state->decompressed_offsets[chunk->frame + 1] : offset + length;
+
+        memcpy((uint8_t*) buffer + (start - offset), chunk->data + (start - state->decompressed_offsets[chunk->frame]), end - start);
+    }
+
+    // Chunks that didn't fit in the cache are dropped once nobody reads them
+    pthread_mutex_lock(&state->lock);
+
+    for (int i = 0; i < total_frames; i++) {
+
+        chunk = decompression.chunks[i];
+        if (chunk == NULL) continue;
+
+        if (--chunk->pins == 0 && !chunk->cached) {
+            free(chunk->data);
+            free(chunk);
+        }
+    }
+
+    pthread_mutex_unlock(&state->lock);
+
+    free(decompression.chunks);
+    free(decompression.missing);
+
+    return bytes_read;
+}
+#endif
@@ -0,0 +1,94 @@
+#ifndef _IMAGE_H_
+#define _IMAGE_H_
+
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <sys/stat.h>
+
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+#include "../parallel/parallel.h"
+#include "../mem/arena.h"
+
+#define MAX_IMAGE_FDS 65536
+#define IMAGE_CACHE_SIZE (64 << 20)
+#define SEEK_TABLE_FOOTER_SIZE 9
+#define SEEKABLE_MAGIC 0x8F92EAB1
+#define SKIPPABLE_MAGIC 0x184D2A5E
+#define SEQUENTIAL_READS 3
+#define SEQUENTIAL_GAP (64 << 10)
+#define READAHEAD_MIN (128 << 10)
+#define READAHEAD_MAX (8 << 20)
+#define DROP_BEHIND_SIZE (64 << 20)
+#define BATCH_GAP (32 << 10)
+#define BATCH_RUN_SIZE (4 << 20)
+
+typedef struct {
+    int frame;
+    uint8_t* data;
+    size_t size;
+    uint64_t last_used;
+    int pins;
+    int cached;
+} ImageChunk;
+
+typedef struct {
+    int fd;
+    off_t position;
+    uint64_t size;
+    int frame_count;
+    uint64_t* compressed_offsets;
+    uint64_t* decompressed_offsets;
+    ImageChunk** slots;
+    int cached_count;
+    ImageChunk** cached;
+    size_t cached_bytes;
+    uint64_t tick;
+    pthread_mutex_t lock;
+} ImageState;
+
+typedef struct {
+    int fd;
+    off_t position;
+    off_t last_end;
+    int sequential_reads;
+    int sequential;
+    off_t window;
+    off_t advised_end;
+    off_t dropped_end;
+    pthread_mutex_t lock;
+} ImageStream;
+
+typedef struct {
+    off_t offset;
+    size_t length;
+    void* buffer;
+} ImageRead;
+
+typedef struct {
+    ImageState* state;
+    int first_frame;
+    ImageChunk** chunks;
+    int* missing;
+} ImageDecompression;
+
+int IMAGE_open(const char *path);
+void IMAGE_close(int fd);
+ssize_t IMAGE_pread(int fd, void *buffer, size_t length, off_t offset);
+ssize_t IMAGE_read(int fd, void *buffer, size_t length);
+off_t IMAGE_lseek(int fd, off_t offset, int whence);
+void IMAGE_willNeed(int fd, off_t offset, off_t length);
+void IMAGE_dontNeed(int fd, off_t offset, off_t length);
+void IMAGE_dropBehind(int fd);
+int IMAGE_getWriteTime(int fd, struct timespec *write_time);
+int IMAGE_readBatch(int fd, ImageRead *reads, int count);
+
+#endif
@@ -0,0 +1,157 @@
+#include "filelist.h"
+
+static int compareEntries(const void *a, const void *b);
+static int getNextPiece(FileEntry *entry, int *index, uint64_t offset, uint64_t length, FileExtent *piece);
+
+FileEntry* FILELIST_add(FileList *list, char *path, uint64_t size, time_t mtime, int is_dir) {
+
+    FileEntry *entry;
+
+    if (list->count == list->capacity) {
+        list->capacity = (list->capacity == 0) ? 64 : list->capacity * 2;
+        list->entries = realloc(list->entries, sizeof(FileEntry) * list->capacity);
+    }
+
+    // The list takes ownership of the path
+    entry = &list->entries[list->count++];
+    memset(entry, 0, sizeof(FileEntry));
+
+    entry->path = path;
+    entry->size = size;
+    entry->mtime = mtime;
+    entry->is_dir = is_dir;
+
+    return entry;
+}
+
+void FILELIST_addExtent(FileEntry *entry, uint64_t logical, uint64_t offset, uint64_t length) {
+
+    FileExtent *last;
+
+    // Nothing past the end of the file is part of its content
+    if (logical >= entry->size) return;
+    if (logical + length > entry->size) length = entry->size - logical;
+
+    // Physically and logically contiguous ranges grow the previous extent
+    if (entry->extent_count > 0) {
+
+        last = &entry->extents[entry->extent_count - 1];
+
+        if (last->logical + last->length == logical && last->offset + last->length == offset) {
+            last->length += length;
+            return;
+        }
+    }
+
+    if (entry->extent_count == entry->extent_capacity) {
+        entry->extent_capacity = (entry->extent_capacity == 0) ? 4 : entry->extent_capacity * 2;
+        entry->extents = realloc(entry->extents, sizeof(FileExtent) * entry->extent_capacity);
+    }
+
+    entry->extents[entry->extent_count].logical = logical;
+    entry->extents[entry->extent_count].offset = offset;
+    entry->extents[entry->extent_count].length = length;
+    entry->extent_count++;
+}
+
+void FILELIST_sort(FileList *list) {
+    qsort(list->entries, list->count, sizeof(FileEntry), compareEntries);
+}
+
+int FILELIST_sameExtents(FileEntry *entry_a, FileEntry *entry_b) {
+
+    if (entry_a->extent_count != entry_b->extent_count) return 0;
+
+    return memcmp(entry_a->extents, entry_b->extents, sizeof(FileExtent) * entry_a->extent_count) == 0;
+}
+
+int FILELIST_sameRange(FileEntry *entry_a, FileEntry *entry_b, uint64_t offset, uint64_t length) {
+
+    FileExtent piece_a, piece_b;
+    int index_a = 0, index_b = 0, found_a, found_b;
+
+    // Extents are merged as they are added, so a range maps the same way in both exactly when its clipped extents match
+    while (1) {
+
+        found_a = getNextPiece(entry_a, &index_a, offset, length, &piece_a);
+        found_b = getNextPiece(entry_b, &index_b, offset, length, &piece_b);
+
+        if (!found_a || !found_b) return found_a == found_b;
+        if (memcmp(&piece_a, &piece_b, sizeof(FileExtent)) != 0) return 0;
+    }
+}
+
+int64_t FILELIST_read(int fd, FileEntry *entry, uint64_t offset, void *buffer, uint64_t length) {
+
+    FileExtent *extent;
+    uint64_t start, end;
+
+    if (offset >= entry->size) return 0;
+    if (offset + length > entry->size) length = entry->size - offset;
+
+    // Holes between extents read as zeros
+    memset(buffer, 0, length);
+
+    for (int i = 0; i < entry->extent_count; i++) {
+
+        extent = &entry->extents[i];
+
+        start = (extent->logical > offset) ? extent->logical : offset;
+        end = (extent->logical + extent->length < offset + length) ? extent->logical + extent->length : offset + length;
+
+        if (start >= end) continue;
+
+        if (IMAGE_pread(fd, (uint8_t*) buffer + (start - offset), end - start, extent->offset + (start - extent->logical)) < 0) return -1;
+
+        // Fragmented files jump between extents, which readahead on the image alone can't follow
+        if (end == extent->logical + extent->length && i + 1 < entry->extent_count) {
+            extent = &entry->extents[i + 1];
+            IMAGE_willNeed(fd, extent->offset, (extent->length < READAHEAD_MAX) ? extent->length : READAHEAD_MAX);
+        }
+    }
+
+    return length;
+}
+
+void FILELIST_free(FileList *list) {
+
+    for (int i = 0; i < list->count; i++) {
+        free(list->entries[i].path);
+        free(list->entries[i].extents);
+    }
+
+    free(list->entries);
+    list->entries = NULL;
+    list->count = 0;
+    list->capacity = 0;
+}
+
+static int getNextPiece(FileEntry *entry, int *index, uint64_t offset, uint64_t length, FileExtent *piece) {
+
+    FileExtent *extent;
+    uint64_t start, end;
+
+    if (offset + length > entry->size) length = (offset < entry->size) ? entry->size - offset : 0;
+
+    while (*index < entry->extent_count) {
+
+        extent = &entry->extents[(*index)++];
+
+        start = (extent->logical > offset) ? extent->logical : offset;
+        end = (extent->logical + extent->length < offset + length) ? extent->logical + extent->length : offset + length;
+
+        if (start >= end) continue;
+
+        piece->logical = start;
+        piece->offset = extent->offset + (start - extent->logical);
+        piece->length = end - start;
+
+        return 1;
+    }
+
+    return 0;
+}
+
+static int compareEntries(const void *a, const void *b) {
+    return strcmp(((const FileEntry*) a)->path, ((const FileEntry*) b)->path);
+}
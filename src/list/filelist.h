@@ -0,0 +1,43 @@
+#ifndef _FILE_LIST_H_
+#define _FILE_LIST_H_
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+#include "../io/image.h"
+
+typedef struct {
+    uint64_t logical;
+    uint64_t offset;
+    uint64_t length;
+} FileExtent;
+
+typedef struct {
+    char* path;
+    uint64_t size;
+    time_t mtime;
+    int is_dir;
+    int extent_count;
+    int extent_capacity;
+    FileExtent* extents;
+} FileEntry;
+
+typedef struct {
+    int count;
+    int capacity;
+    FileEntry* entries;
+} FileList;
+
+FileEntry* FILELIST_add(FileList *list, char *path, uint64_t size, time_t mtime, int is_dir);
+void FILELIST_addExtent(FileEntry *entry, uint64_t logical, uint64_t offset, uint64_t length);
+void FILELIST_sort(FileList *list);
+int FILELIST_sameExtents(FileEntry *entry_a, FileEntry *entry_b);
+int FILELIST_sameRange(FileEntry *entry_a, FileEntry *entry_b, uint64_t offset, uint64_t length);
+int64_t FILELIST_read(int fd, FileEntry *entry, uint64_t offset, void *buffer, uint64_t length);
+void FILELIST_free(FileList *list);
+
+#endif
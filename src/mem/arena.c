@@ -0,0 +1,157 @@
+#include "arena.h"
+
+// Shared by every arena and cache in the process, 0 means no limit
+static size_t memory_limit = 0;
+static size_t memory_used = 0;
+
+static ArenaBlock* addBlock(Arena *arena, size_t size);
+
+void ARENA_setLimit(size_t limit) {
+    memory_limit = limit;
+}
+
+int ARENA_parseSize(char *value, size_t *size) {
+
+    char *end;
+
+    *size = strtoull(value, &end, 10);
+
+    if (end == value) return -1;
+
+    switch (*end) {
+        case '\0':
+            return 0;
+        case 'k':
+        case 'K':
+            *size <<= 10;
+            break;
+        case 'M':
+            *size <<= 20;
+            break;
+        case 'G':
+            *size <<= 30;
+            break;
+        default:
+            return -1;
+    }
+
+    return end[1] == '\0' ? 0 : -1;
+}
+
+int ARENA_reserve(size_t size) {
+
+    size_t used;
+
+    used = __atomic_add_fetch(&memory_used, size, __ATOMIC_RELAXED);
+
+    if (memory_limit != 0 && used > memory_limit) {
+        __atomic_sub_fetch(&memory_used, size, __ATOMIC_RELAXED);
+        return -1;
+    }
+
+    return 0;
+}
+
+void ARENA_release(size_t size) {
+    __atomic_sub_fetch(&memory_used, size, __ATOMIC_RELAXED);
+}
+
+void ARENA_init(Arena *arena) {
+    arena->blocks = NULL;
+    arena->allocated = 0;
+}
+
+void* ARENA_alloc(Arena *arena, size_t size) {
+
+    ArenaBlock *block;
+    size_t offset;
+
+    block = arena->blocks;
+    offset = (block != NULL) ? (block->used + ARENA_ALIGNMENT - 1) & ~((size_t) ARENA_ALIGNMENT - 1) : 0;
+
+    if (block == NULL || offset + size > block->size) {
+
+        // Allocations bigger than a block get one of their own
+        if ((block = addBlock(arena, (size > ARENA_BLOCK_SIZE) ? size : ARENA_BLOCK_SIZE)) == NULL) return NULL;
+        offset = 0;
+    }
+
+    block->used = offset + size;
+
+    return (uint8_t*) (block + 1) + offset;
+}
+
+void* ARENA_copy(Arena *arena, const void *data, size_t size) {
+
+    void *copy;
+
+    if ((copy = ARENA_alloc(arena, size)) != NULL) memcpy(copy, data, size);
+
+    return copy;
+}
+
+char* ARENA_copyString(Arena *arena, const char *string, size_t length) {
+
+    char *copy;
+
+    if ((copy = ARENA_alloc(arena, length + 1)) == NULL) return NULL;
+
+    memcpy(copy, string, length);
+    copy[length] = '\0';
+
+    return copy;
+}
+
+void ARENA_reset(Arena *arena) {
+
+    ArenaBlock *block;
+
+    if (arena->blocks == NULL) return;
+
+    // Only the oldest block is kept, the next round of allocations most likely needs it again
+    while (arena->blocks->next != NULL) {
+
+        block = arena->blocks;
+        arena->blocks = block->next;
+
+        arena->allocated -= block->size;
+        ARENA_release(block->size);
+        free(block);
+    }
+
+    arena->blocks->used = 0;
+}
+
+void ARENA_free(Arena *arena) {
+
+    ArenaBlock *block;
+
+    while ((block = arena->blocks) != NULL) {
+        arena->blocks = block->next;
+        free(block);
+    }
+
+    ARENA_release(arena->allocated);
+    arena->allocated = 0;
+}
+
+static ArenaBlock* addBlock(Arena *arena, size_t size) {
+
+    ArenaBlock *block;
+
+    if (ARENA_reserve(size) < 0) return NULL;
+
+    if ((block = malloc(sizeof(ArenaBlock) + size)) == NULL) {
+        ARENA_release(size);
+        return NULL;
+    }
+
+    block->size = size;
+    block->used = 0;
+    block->next = arena->blocks;
+
+    arena->blocks = block;
+    arena->allocated += size;
+
+    return block;
+}
@@ -0,0 +1,34 @@
+#ifndef _ARENA_H_
+#define _ARENA_H_
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+#define ARENA_BLOCK_SIZE (64 << 10)
+#define ARENA_ALIGNMENT 8
+
+typedef struct ArenaBlock {
+    struct ArenaBlock* next;
+    size_t size;
+    size_t used;
+} ArenaBlock;
+
+typedef struct {
+    ArenaBlock* blocks;
+    size_t allocated;
+} Arena;
+
+void ARENA_setLimit(size_t limit);
+int ARENA_parseSize(char *value, size_t *size);
+int ARENA_reserve(size_t size);
+void ARENA_release(size_t size);
+void ARENA_init(Arena *arena);
+void* ARENA_alloc(Arena *arena, size_t size);
+void* ARENA_copy(Arena *arena, const void *data, size_t size);
+char* ARENA_copyString(Arena *arena, const char *string, size_t length);
+void ARENA_reset(Arena *arena);
+void ARENA_free(Arena *arena);
+
+#endif
@@ -0,0 +1,94 @@
+#include "parallel.h"
+
+// Depth of parallel tasks running on this thread while other workers run beside it
+static __thread int worker_depth;
+
+static void* runTask(void *arg);
+static void drainQueue(int worker, int begin, int end, void *ctx);
+
+int PARALLEL_getThreadCount(int total) {
+
+    long threads;
+
+    threads = sysconf(_SC_NPROCESSORS_ONLN);
+
+    if (threads < 1) threads = 1;
+    if (threads > MAX_THREADS) threads = MAX_THREADS;
+    if (threads > total) threads = total;
+
+    return (threads < 1) ? 1 : threads;
+}
+
+void PARALLEL_run(int total, int threads, void (*work)(int worker, int begin, int end, void *ctx), void *ctx) {
+
+    pthread_t ids[MAX_THREADS];
+    ParallelTask tasks[MAX_THREADS];
+    int started[MAX_THREADS];
+
+    if (threads > MAX_THREADS) threads = MAX_THREADS;
+    if (threads < 1) threads = 1;
+
+    // Each worker gets one contiguous range, so results can be reduced in order afterwards
+    for (int i = 0; i < threads; i++) {
+
+        tasks[i].worker = i;
+        tasks[i].begin = (int) ((long) total * i / threads);
+        tasks[i].end = (int) ((long) total * (i + 1) / threads);
+        tasks[i].shared = threads > 1;
+        tasks[i].work = work;
+        tasks[i].ctx = ctx;
+
+        started[i] = (i > 0) && pthread_create(&ids[i], NULL, runTask, &tasks[i]) == 0;
+    }
+
+    // Calling thread takes the first range, and any range whose thread failed to start
+    runTask(&tasks[0]);
+
+    for (int i = 1; i < threads; i++) {
+
+        if (started[i]) pthread_join(ids[i], NULL);
+        else runTask(&tasks[i]);
+    }
+}
+
+void PARALLEL_runQueue(int total, int threads, void (*work)(int worker, int index, void *ctx), void *ctx) {
+
+    ParallelQueue queue;
+
+    queue.next = 0;
+    queue.total = total;
+    queue.work = work;
+    queue.ctx = ctx;
+
+    // One range per worker, each one pulling items until the queue is empty so uneven items stay balanced
+    PARALLEL_run(threads, threads, drainQueue, &queue);
+}
+
+int PARALLEL_inWorker(void) {
+
+    return worker_depth > 0;
+}
+
+static void* runTask(void *arg) {
+
+    ParallelTask *task = arg;
+
+    if (task->shared) worker_depth++;
+    if (task->begin < task->end) task->work(task->worker, task->begin, task->end, task->ctx);
+    if (task->shared) worker_depth--;
+
+    return NULL;
+}
+
+static void drainQueue(int worker, int begin, int end, void *ctx) {
+
+    ParallelQueue *queue = ctx;
+    int index;
+
+    (void) begin;
+    (void) end;
+
+    while ((index = __atomic_fetch_add(&queue->next, 1, __ATOMIC_RELAXED)) < queue->total) {
+        queue->work(worker, index, queue->ctx);
+    }
+}
\ No newline at end of file
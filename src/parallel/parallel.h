@@ -0,0 +1,32 @@
+#ifndef _PARALLEL_H_
+#define _PARALLEL_H_
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#define MAX_THREADS 64
+
+typedef struct {
+    int worker;
+    int begin;
+    int end;
+    int shared;
+    void (*work)(int worker, int begin, int end, void *ctx);
+    void* ctx;
+} ParallelTask;
+
+typedef struct {
+    int next;
+    int total;
+    void (*work)(int worker, int index, void *ctx);
+    void* ctx;
+} ParallelQueue;
+
+int PARALLEL_getThreadCount(int total);
+void PARALLEL_run(int total, int threads, void (*work)(int worker, int begin, int end, void *ctx), void *ctx);
+void PARALLEL_runQueue(int total, int threads, void (*work)(int worker, int index, void *ctx), void *ctx);
+int PARALLEL_inWorker(void);
+
+#endif
@@ -0,0 +1,245 @@
+#include "tree.h"
+
+static void printEntries(Tree *tree, int dir, char *nesting);
+static void pushFrame(TreeCursor *cursor, uint64_t dir_id, uint64_t cookie, int is_last);
+static int parseCursor(TreeCursor *cursor, char *token);
+static int checkCursor(Backend *backend, void *mount, TreeCursor *cursor);
+static void printCursor(TreeCursor *cursor);
+static int readVisible(Backend *backend, void *mount, TreeFrame *frame, uint64_t *cookie, BackendEntry *entry);
+
+void TREE_init(Tree *tree, uint64_t root_id) {
+
+    tree->count = 0;
+    tree->capacity = 0;
+    tree->entries = NULL;
+    tree->truncated = 0;
+
+    ARENA_init(&tree->arena);
+
+    TREE_add(tree, -1, "", 0, root_id, 1);
+}
+
+int TREE_add(Tree *tree, int parent, char *name, int name_length, uint64_t id, int is_dir) {
+
+    TreeEntry *entry, *entries;
+    char *entry_name;
+
+    if (tree->truncated) return -1;
+
+    // Old arrays stay in the arena until the tree is freed, together they are never bigger than the last one
+    if (tree->count == tree->capacity) {
+
+        if ((entries = ARENA_alloc(&tree->arena, sizeof(TreeEntry) * ((tree->capacity == 0) ? 64 : tree->capacity * 2))) == NULL) {
+            tree->truncated = 1;
+            return -1;
+        }
+
+        if (tree->count > 0) memcpy(entries, tree->entries, sizeof(TreeEntry) * tree->count);
+
+        tree->capacity = (tree->capacity == 0) ? 64 : tree->capacity * 2;
+        tree->entries = entries;
+    }
+
+    if ((entry_name = ARENA_copyString(&tree->arena, name, name_length)) == NULL) {
+        tree->truncated = 1;
+        return -1;
+    }
+
+    entry = &tree->entries[tree->count];
+    entry->name = entry_name;
+    entry->id = id;
+    entry->is_dir = is_dir;
+    entry->first_child = 0;
+    entry->child_count = 0;
+
+    // A directory is loaded in one go, so its children always end up next to each other
+    if (parent >= 0) {
+        if (tree->entries[parent].child_count++ == 0) tree->entries[parent].first_child = tree->count;
+    }
+
+    return tree->count++;
+}
+
+void TREE_print(Tree *tree) {
+
+    if (tree->count > 0) printEntries(tree, 0, "");
+
+    if (tree->truncated) printf("ERROR: Memory limit reached, tree is incomplete.\n");
+}
+
+void TREE_free(Tree *tree) {
+
+    // Names and entries all live in the arena
+    ARENA_free(&tree->arena);
+
+    tree->entries = NULL;
+    tree->count = 0;
+    tree->capacity = 0;
+}
+
+int TREE_printPage(Backend *backend, void *mount, int limit, char *token) {
+
+    TreeCursor cursor;
+    TreeFrame *frame;
+    BackendEntry entry, next;
+    uint64_t next_cookie;
+    int printed = 0, is_last;
+
+    memset(&cursor, 0, sizeof(TreeCursor));
+
+    // The walk is a stack of directories and readdir cookies, so any point of it can be written down and picked up again
+    if (token == NULL) {
+        pushFrame(&cursor, backend->root_id, 0, 0);
+    }
+    else if (parseCursor(&cursor, token) < 0 || checkCursor(backend, mount, &cursor) < 0) {
+        free(cursor.frames);
+        return -1;
+    }
+
+    while (cursor.depth > 0 && (limit == 0 || printed < limit)) {
+
+        frame = &cursor.frames[cursor.depth - 1];
+
+        if (frame->finished || readVisible(backend, mount, frame, &frame->cookie, &entry) <= 0) {
+            cursor.depth--;
+            continue;
+        }
+
+        // One entry of lookahead tells whether this is the last one in its directory
+        next_cookie = frame->cookie;
+        is_last = readVisible(backend, mount, frame, &next_cookie, &next) <= 0;
+        frame->finished = is_last;
+
+        for (int i = 1; i < cursor.depth; i++) {
+            fputs(cursor.frames[i].is_last ? "	" : "│	", stdout);
+        }
+
+        printf("%s %s\n", is_last ? "└" : "├", entry.name);
+        printed++;
+
+        if (entry.is_dir) pushFrame(&cursor, entry.id, 0, is_last);
+    }
+
+    // Directories with nothing left to print are dropped, so the last page never hands out a cursor to an empty one
+    while (cursor.depth > 0) {
+
+        frame = &cursor.frames[cursor.depth - 1];
+        next_cookie = frame->cookie;
+
+        if (!frame->finished && readVisible(backend, mount, frame, &next_cookie, &next) > 0) break;
+        cursor.depth--;
+    }
+
+    if (cursor.depth > 0) printCursor(&cursor);
+
+    free(cursor.frames);
+
+    return 0;
+}
+
+static void printEntries(Tree *tree, int dir, char *nesting) {
+
+    TreeEntry *entry;
+    char *child_nesting;
+    int is_last;
+
+    for (int i = 0; i < tree->entries[dir].child_count; i++) {
+
+        entry = &tree->entries[tree->entries[dir].first_child + i];
+        is_last = i == tree->entries[dir].child_count - 1;
+
+        printf("%s%s %s\n", nesting, is_last ? "└" : "├", entry->name);
+
+        if (entry->child_count == 0) continue;
+
+        child_nesting = malloc(strlen(nesting) + 5);
+        sprintf(child_nesting, "%s%s\t", nesting, is_last ? "" : "│");
+
+        printEntries(tree, tree->entries[dir].first_child + i, child_nesting);
+
+        free(child_nesting);
+    }
+}
+
+static void pushFrame(TreeCursor *cursor, uint64_t dir_id, uint64_t cookie, int is_last) {
+
+    if (cursor->depth == cursor->capacity) {
+        cursor->capacity = (cursor->capacity == 0) ? 16 : cursor->capacity * 2;
+        cursor->frames = realloc(cursor->frames, sizeof(TreeFrame) * cursor->capacity);
+    }
+
+    cursor->frames[cursor->depth].dir_id = dir_id;
+    cursor->frames[cursor->depth].cookie = cookie;
+    cursor->frames[cursor->depth].is_last = is_last;
+    cursor->frames[cursor->depth].finished = 0;
+    cursor->depth++;
+}
+
+static int parseCursor(TreeCursor *cursor, char *token) {
+
+    uint64_t dir_id, cookie;
+    char *end;
+    int is_last;
+
+    // Frames from the root down, each one as <dir id>.<cookie>.<last> in hex and separated by '/'
+    do {
+
+        dir_id = strtoull(token, &end, 16);
+        if (end == token || *end != '.') return -1;
+
+        cookie = strtoull(token = end + 1, &end, 16);
+        if (end == token || *end != '.') return -1;
+
+        token = end + 1;
+        if (*token != '0' && *token != '1') return -1;
+        is_last = *token++ == '1';
+
+        pushFrame(cursor, dir_id, cookie, is_last);
+
+    } while (*token++ == '/');
+
+    return token[-1] == '\0' ? 0 : -1;
+}
+
+static int checkCursor(Backend *backend, void *mount, TreeCursor *cursor) {
+
+    BackendStat stat;
+    BackendEntry entry;
+    uint64_t cookie;
+
+    // Tokens come from the command line, so every frame must be a directory from the root down and a position inside it
+    if (cursor->frames[0].dir_id != backend->root_id) return -1;
+
+    for (int i = 0; i < cursor->depth; i++) {
+
+        cookie = cursor->frames[i].cookie;
+
+        if (backend->stat(mount, cursor->frames[i].dir_id, &stat) < 0 || !stat.is_dir) return -1;
+        if (backend->readdir(mount, cursor->frames[i].dir_id, &cookie, &entry) < 0) return -1;
+    }
+
+    return 0;
+}
+
+static void printCursor(TreeCursor *cursor) {
+
+    printf("Cursor: ");
+
+    for (int i = 0; i < cursor->depth; i++) {
+        printf("%s%llx.%llx.%d", (i > 0) ? "/" : "", (unsigned long long) cursor->frames[i].dir_id, (unsigned long long) cursor->frames[i].cookie, cursor->frames[i].is_last);
+    }
+
+    printf("\n");
+}
+
+static int readVisible(Backend *backend, void *mount, TreeFrame *frame, uint64_t *cookie, BackendEntry *entry) {
+
+    int result;
+
+    // Same entries as the full tree, which leaves fsck's lost+found out
+    while ((result = backend->readdir(mount, frame->dir_id, cookie, entry)) > 0) {
+        if (strcmp(entry->name, "lost+found") != 0) break;
+    }
+
+    return result;
+}
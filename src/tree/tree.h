@@ -0,0 +1,49 @@
+#ifndef _TREE_H_
+#define _TREE_H_
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+#include "../mem/arena.h"
+#include "../backend/backend.h"
+
+#define TREE_BATCH_SIZE (16 << 20)
+
+typedef struct {
+    char* name;
+    uint64_t id;
+    int is_dir;
+    int first_child;
+    int child_count;
+} TreeEntry;
+
+typedef struct {
+    int count;
+    int capacity;
+    TreeEntry* entries;
+    int truncated;
+    Arena arena;
+} Tree;
+
+typedef struct {
+    uint64_t dir_id;
+    uint64_t cookie;
+    int is_last;
+    int finished;
+} TreeFrame;
+
+typedef struct {
+    int depth;
+    int capacity;
+    TreeFrame* frames;
+} TreeCursor;
+
+void TREE_init(Tree *tree, uint64_t root_id);
+int TREE_add(Tree *tree, int parent, char *name, int name_length, uint64_t id, int is_dir);
+void TREE_print(Tree *tree);
+void TREE_free(Tree *tree);
+int TREE_printPage(Backend *backend, void *mount, int limit, char *cursor);
+
+#endif
@@ -0,0 +1,281 @@
+#include "watch.h"
+
+static int compareEntries(const void *a, const void *b);
+static char* getChildPath(char *path, char *name);
+static void loadDirectory(WatchTree *tree, uint64_t id, char *path, int report);
+static void dropDirectory(WatchTree *tree, uint64_t id, int report);
+static void freeEntries(WatchEntry *entries, int count);
+
+void WATCH_load(WatchTree *tree, uint64_t root_id) {
+
+    tree->count = 0;
+    tree->capacity = 0;
+    tree->directories = NULL;
+
+    loadDirectory(tree, root_id, "", 0);
+}
+
+WatchDirectory* WATCH_findDirectory(WatchTree *tree, uint64_t id) {
+
+    int low = 0, high = tree->count - 1, middle;
+
+    while (low <= high) {
+
+        middle = (low + high) / 2;
+
+        if (tree->directories[middle].id == id) return &tree->directories[middle];
+
+        if (tree->directories[middle].id < id) low = middle + 1;
+        else high = middle - 1;
+    }
+
+    return NULL;
+}
+
+int WATCH_findParents(WatchTree *tree, uint64_t *ids, int count, uint8_t *found, uint64_t **parents) {
+
+    int low, high, middle, parent_count = 0, is_parent;
+
+    *parents = NULL;
+    memset(found, 0, count);
+
+    // A single memory walk for the whole sorted batch, hard links can give a file several parents
+    for (int i = 0; i < tree->count; i++) {
+
+        is_parent = 0;
+
+        for (int j = 0; j < tree->directories[i].count; j++) {
+
+            low = 0;
+            high = count - 1;
+
+            while (low <= high) {
+
+                middle = (low + high) / 2;
+
+                if (ids[middle] == tree->directories[i].entries[j].id) break;
+
+                if (ids[middle] < tree->directories[i].entries[j].id) low = middle + 1;
+                else high = middle - 1;
+            }
+
+            if (low > high) continue;
+
+            found[middle] = 1;
+            is_parent = 1;
+        }
+
+        if (!is_parent) continue;
+
+        *parents = realloc(*parents, sizeof(uint64_t) * (parent_count + 1));
+        (*parents)[parent_count++] = tree->directories[i].id;
+    }
+
+    return parent_count;
+}
+
+int WATCH_refresh(WatchTree *tree, uint64_t id) {
+
+    WatchDirectory *directory, *child;
+    WatchEntry *old_entries, *new_entries, *old_entry, *new_entry;
+    uint64_t fingerprint;
+    int old_count, new_count, i = 0, j = 0, order, changes = 0;
+    char *path, *child_path;
+
+    if ((directory = WATCH_findDirectory(tree, id)) == NULL) return 0;
+
+    if ((new_count = tree->list(id, &new_entries, &fingerprint, tree->ctx)) < 0) return 0;
+    qsort(new_entries, new_count, sizeof(WatchEntry), compareEntries);
+
+    // Loading and dropping subdirectories moves directories around, so only their entries are held on to
+    old_entries = directory->entries;
+    old_count = directory->count;
+    path = strdup(directory->path);
+
+    while (i < old_count || j < new_count) {
+
+        old_entry = (i < old_count) ? &old_entries[i] : NULL;
+        new_entry = (j < new_count) ? &new_entries[j] : NULL;
+
+        if (old_entry == NULL) order = 1;
+        else if (new_entry == NULL) order = -1;
+        else order = strcmp(old_entry->name, new_entry->name);
+
+        // Same name pointing to another file is a replacement, not a modification
+        if (order == 0 && (old_entry->id != new_entry->id || old_entry->is_dir != new_entry->is_dir)) {
+            order = -1;
+            new_entry = NULL;
+        }
+
+        child_path = getChildPath(path, (order <= 0) ? old_entry->name : new_entry->name);
+
+        if (order < 0) {
+
+            printf("D %s\n", child_path);
+
+            // A directory moved elsewhere was already re-homed under its new path
+            child = old_entry->is_dir ? WATCH_findDirectory(tree, old_entry->id) : NULL;
+            if (child != NULL && strcmp(child->path, child_path) == 0) dropDirectory(tree, old_entry->id, 1);
+
+            i++;
+            changes++;
+        }
+        else if (order > 0) {
+
+            printf("A %s\n", child_path);
+
+            if (new_entry->is_dir) {
+
+                child = WATCH_findDirectory(tree, new_entry->id);
+
+                // Unless it is one of our own ancestors, which only a corrupt image can do
+                if (child != NULL && strncmp(child_path, child->path, strlen(child->path)) != 0) {
+                    dropDirectory(tree, new_entry->id, 0);
+                }
+
+                loadDirectory(tree, new_entry->id, child_path, 1);
+            }
+
+            j++;
+            changes++;
+        }
+        else {
+
+            // Directories report their own changes when they are refreshed
+            if (!new_entry->is_dir && (old_entry->size != new_entry->size || old_entry->mtime != new_entry->mtime)) {
+                printf("M %s\n", child_path);
+                changes++;
+            }
+
+            i++;
+            j++;
+        }
+
+        free(child_path);
+    }
+
+    directory = WATCH_findDirectory(tree, id);
+
+    if (directory != NULL) {
+        directory->entries = new_entries;
+        directory->count = new_count;
+        directory->fingerprint = fingerprint;
+    }
+    else {
+        freeEntries(new_entries, new_count);
+    }
+
+    freeEntries(old_entries, old_count);
+    free(path);
+
+    return changes;
+}
+
+void WATCH_free(WatchTree *tree) {
+
+    for (int i = 0; i < tree->count; i++) {
+        freeEntries(tree->directories[i].entries, tree->directories[i].count);
+        free(tree->directories[i].path);
+    }
+
+    free(tree->directories);
+    tree->directories = NULL;
+    tree->count = 0;
+    tree->capacity = 0;
+}
+
+static int compareEntries(const void *a, const void *b) {
+    return strcmp(((WatchEntry*) a)->name, ((WatchEntry*) b)->name);
+}
+
+static char* getChildPath(char *path, char *name) {
+
+    char *child_path;
+
+    child_path = malloc(strlen(path) + strlen(name) + 2);
+    sprintf(child_path, "%s/%s", path, name);
+
+    return child_path;
+}
+
+static void loadDirectory(WatchTree *tree, uint64_t id, char *path, int report) {
+
+    WatchDirectory directory;
+    WatchEntry *entries;
+    uint64_t fingerprint;
+    int count, index = 0;
+    char *child_path;
+
+    // Directories already in the tree are loops in the image
+    if (WATCH_findDirectory(tree, id) != NULL) return;
+
+    if ((count = tree->list(id, &entries, &fingerprint, tree->ctx)) < 0) return;
+    qsort(entries, count, sizeof(WatchEntry), compareEntries);
+
+    if (tree->count == tree->capacity) {
+        tree->capacity = (tree->capacity == 0) ? 64 : tree->capacity * 2;
+        tree->directories = realloc(tree->directories, sizeof(WatchDirectory) * tree->capacity);
+    }
+
+    // Kept sorted by id, so refreshes can find directories with a binary search
+    while (index < tree->count && tree->directories[index].id < id) index++;
+    memmove(&tree->directories[index + 1], &tree->directories[index], sizeof(WatchDirectory) * (tree->count - index));
+
+    directory.id = id;
+    directory.fingerprint = fingerprint;
+    directory.path = strdup(path);
+    directory.count = count;
+    directory.entries = entries;
+
+    tree->directories[index] = directory;
+    tree->count++;
+
+    for (int i = 0; i < count; i++) {
+
+        child_path = getChildPath(path, entries[i].name);
+
+        if (report) printf("A %s\n", child_path);
+        if (entries[i].is_dir) loadDirectory(tree, entries[i].id, child_path, report);
+
+        free(child_path);
+    }
+}
+
+static void dropDirectory(WatchTree *tree, uint64_t id, int report) {
+
+    WatchDirectory *directory;
+    WatchEntry *entries;
+    int count, index;
+    char *path, *child_path;
+
+    if ((directory = WATCH_findDirectory(tree, id)) == NULL) return;
+
+    index = directory - tree->directories;
+    entries = directory->entries;
+    count = directory->count;
+    path = directory->path;
+
+    // Unlinked from the tree first, so loops can't bring the walk back here
+    memmove(&tree->directories[index], &tree->directories[index + 1], sizeof(WatchDirectory) * (tree->count - index - 1));
+    tree->count--;
+
+    for (int i = 0; i < count; i++) {
+
+        child_path = getChildPath(path, entries[i].name);
+
+        if (report) printf("D %s\n", child_path);
+        if (entries[i].is_dir) dropDirectory(tree, entries[i].id, report);
+
+        free(child_path);
+    }
+
+    freeEntries(entries, count);
+    free(path);
+}
+
+static void freeEntries(WatchEntry *entries, int count) {
+
+    for (int i = 0; i < count; i++) free(entries[i].name);
+
+    free(entries);
+}
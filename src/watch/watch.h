@@ -0,0 +1,40 @@
+#ifndef _WATCH_H_
+#define _WATCH_H_
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <time.h>
+
+typedef struct {
+    char* name;
+    uint64_t id;
+    uint64_t size;
+    time_t mtime;
+    int is_dir;
+} WatchEntry;
+
+typedef struct {
+    uint64_t id;
+    uint64_t fingerprint;
+    char* path;
+    int count;
+    WatchEntry* entries;
+} WatchDirectory;
+
+typedef struct {
+    int count;
+    int capacity;
+    WatchDirectory* directories;
+    int (*list)(uint64_t id, WatchEntry **entries, uint64_t *fingerprint, void *ctx);
+    void* ctx;
+} WatchTree;
+
+void WATCH_load(WatchTree *tree, uint64_t root_id);
+WatchDirectory* WATCH_findDirectory(WatchTree *tree, uint64_t id);
+int WATCH_findParents(WatchTree *tree, uint64_t *ids, int count, uint8_t *found, uint64_t **parents);
+int WATCH_refresh(WatchTree *tree, uint64_t id);
+void WATCH_free(WatchTree *tree);
+
+#endif